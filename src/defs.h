@@ -1,5 +1,6 @@
 /* See LICENSE for more information on use */
 #pragma once
+#include <stdint.h>
 #include <X11/Xlib.h>
 #define SXWM_VERSION "sxwm ver. 1.8"
 #define SXWM_AUTHOR "(C) Abhinav Prasai 2025"
@@ -12,13 +13,52 @@
 #define UDIST(a, b)          abs((int)(a) - (int)(b))
 #define CLAMP(x, lo, hi)     (((x) < (lo)) ? (lo) : ((x) > (hi)) ? (hi) : (x))
 
+#define HIST_BUCKETS         21
+#define IPC_MAX_BATCH        64
+#define IPC_MAX_CONNS        16
+#define IPC_IN_SIZE          4096
+#define IPC_OUT_SIZE         32768
 #define MAX_MONITORS         32
 #define MAX_BINDS            256
 #define MAX_CLIENTS          99
 #define MAX_SCRATCHPADS      32
 #define MAX_ITEMS            256
+#define MAX_PIPELINE         8
+#define MAX_NET_STATES       16
+#define MAX_DOCKS            16
 #define MIN_WINDOW_SIZE      20
 #define PATH_MAX             4096
+#define PROC_CACHE_SIZE      256
+#define PROC_MAX_DEPTH       20
+#define RESTART_VERSION      2
+#define RING_DEPTH           4     /* spans open at once, a tile inside an event */
+#define RING_SIZE            4096  /* power of two */
+#define RING_VERSION         2
+#define RT_MAX_SITES         128
+#define SNAPSHOT_VERSION     1
+#define SWALLOW_INDEX_SIZE   64
+#define TRACE_ATOM_BASE      0x10000000  /* atoms[] index offset in traces */
+#define TRACE_VERSION        1
+#define TRACE_WIN_SLOTS      4096
+
+/* ipc subscription topics */
+#define IPC_EV_FOCUS         (1 << 0)
+#define IPC_EV_WORKSPACE     (1 << 1)
+#define IPC_EV_CLIENT_ADD    (1 << 2)
+#define IPC_EV_CLIENT_REMOVE (1 << 3)
+#define IPC_EV_LAYOUT        (1 << 4)
+#define IPC_EV_MONITOR       (1 << 5)
+
+/* RingEntry kinds */
+#define RING_EVENT           0
+#define RING_TILE            1
+#define RING_GRAB            2
+
+/* SnapshotClient flags */
+#define SNAP_FLOATING        (1 << 0)
+#define SNAP_FULLSCREEN      (1 << 1)
+#define SNAP_MAPPED          (1 << 2)
+#define SNAP_FOCUSED         (1 << 3)
 
 /* workspaces */
 #define TYPE_WS_CHANGE       0
@@ -30,6 +70,26 @@
 #define TYPE_SP_REMOVE       4
 #define TYPE_SP_TOGGLE       5
 #define TYPE_SP_CREATE       6
+/* ipc batches only */
+#define TYPE_FOCUS           7
+
+/* work deferred while a batch runs */
+#define DEFER_TILE           (1 << 0)
+#define DEFER_BORDERS        (1 << 1)
+#define DEFER_CLIENT_LIST    (1 << 2)
+#define DEFER_DESKTOPS       (1 << 3)
+#define DEFER_RESTACK        (1 << 4)
+
+/* stacking layers, bottom to top */
+#define STACK_TILED          0
+#define STACK_FLOATING       1
+#define STACK_FULLSCREEN     2
+#define STACK_SCRATCHPAD     3
+#define STACK_LAYERS         4
+
+/* events the wm selects on root */
+#define ROOT_EVENT_MASK      (StructureNotifyMask | SubstructureRedirectMask | SubstructureNotifyMask | \
+                              KeyPressMask | PropertyChangeMask)
 
 #define NUM_WORKSPACES		 9
 #define WORKSPACE_NAMES	\
@@ -47,11 +107,18 @@
 typedef enum { DRAG_NONE, DRAG_MOVE, DRAG_RESIZE, DRAG_SWAP } DragMode;
 typedef void (*EventHandler)(XEvent *);
 
+typedef struct {
+	char **args;                 /* tokens, every "|" replaced by NULL */
+	char **stages[MAX_PIPELINE]; /* argv of each pipeline stage */
+	int n_stages;
+} Command;
+
 typedef union {
-	const char **cmd;
+	Command *cmd;
 	void (*fn)(void);
 	int ws;            /* workspace */
 	int sp;            /* scratchpad */
+	Window win;        /* focus target */
 } Action;
 
 typedef struct {
@@ -69,14 +136,24 @@ typedef struct Client {
 	int custom_stack_height;
 	int mon;
 	int ws;
+	int desktop; /* last published _NET_WM_DESKTOP, -1 if none */
+	Atom states[MAX_NET_STATES]; /* cached _NET_WM_STATE */
+	int n_states; /* -1 until read */
+	int state_echoes; /* our _NET_WM_STATE writes not yet notified */
+	Bool state_set; /* _NET_WM_STATE exists on the server, as far as we know */
+	int take_focus; /* WM_TAKE_FOCUS in WM_PROTOCOLS, -1 until read */
+	Bool protocols_echo; /* our WM_PROTOCOLS write not yet notified */
+	long border_col; /* border colour last set, -1 if unknown */
 	Bool fixed;
 	Bool floating;
 	Bool fullscreen;
 	Bool mapped;
+	Bool offscreen;
 	pid_t pid;
 	struct Client *next;
 	struct Client *swallowed;
 	struct Client *swallower;
+	struct Client *swallow_next; /* swallow_index bucket chain */
 } Client;
 
 typedef struct {
@@ -91,6 +168,7 @@ typedef struct {
 	int resize_master_amt;
 	int resize_stack_amt;
 	int snap_distance;
+	int stall_budget;            /* ms, 0 = off */
 	int n_binds;
 	int move_window_amt;
 	int resize_window_amt;
@@ -98,6 +176,8 @@ typedef struct {
 	Bool warp_cursor;
 	Bool floating_on_top;
 	Bool new_win_master;
+	Bool hide_offscreen;
+	Bool handler_timing;
 	Binding binds[MAX_ITEMS];
 	char **should_float[MAX_ITEMS];
 	char **start_fullscreen[MAX_ITEMS];
@@ -105,7 +185,7 @@ typedef struct {
 	char **can_be_swallowed[MAX_ITEMS];
 	char **scratchpads[MAX_SCRATCHPADS];
 	char **open_in_workspace[MAX_ITEMS];
-	char *to_run[MAX_ITEMS];
+	Command *to_run[MAX_ITEMS];
 } Config;
 
 typedef struct {
@@ -125,12 +205,139 @@ typedef struct {
 	Bool enabled;
 } Scratchpad;
 
+typedef struct {
+	int fd;                   /* -1 when the slot is free */
+	unsigned int subs;        /* IPC_EV_* topics the peer subscribed to */
+	size_t in_len;
+	size_t out_len;
+	char in[IPC_IN_SIZE];     /* partial requests */
+	char out[IPC_OUT_SIZE];   /* replies the peer has not read yet */
+} IpcConn;
+
+typedef struct {
+	unsigned long events[LASTEvent];
+	unsigned long requests[LASTEvent];         /* X requests issued while handling */
+	unsigned long tiles;
+	unsigned long configures;
+	unsigned long configures_skipped;  /* geometry unchanged, no request sent */
+	unsigned long border_updates;
+	unsigned long syncs;
+	unsigned long grabs;
+	unsigned long long grab_ns;        /* server grabbed in change_workspace */
+	unsigned long clients_added;
+	unsigned long clients_removed;
+	unsigned long hist[LASTEvent][HIST_BUCKETS];  /* handler_timing, log2 microseconds */
+	unsigned long long hist_ns[LASTEvent];
+	unsigned long rt_calls[LASTEvent];         /* blocking calls by triggering event, 0 = none */
+	unsigned long long rt_ns[LASTEvent];
+	unsigned long rt_max[LASTEvent];           /* most blocking calls made by one event */
+} Stats;
+
+typedef struct {
+	const char *func;
+	int line;
+	unsigned long calls;
+	unsigned long long ns;
+} RoundTripSite;
+
+/* shared state file, fixed width so other languages can map it */
+typedef struct {
+	uint64_t win;
+	int32_t x, y, w, h;
+	int32_t ws, mon;
+	uint32_t flags;           /* SNAP_* */
+	uint32_t pad;
+} SnapshotClient;
+
+typedef struct {
+	volatile uint32_t seq;    /* odd while sxwm is writing, readers retry */
+	uint32_t version;
+	uint32_t size;
+	int32_t current_ws;
+	int32_t current_mon;
+	int32_t n_clients;
+	uint64_t focused;
+	SnapshotClient clients[MAX_CLIENTS];
+} Snapshot;
+
+/* --record trace file: one TraceHeader, then a TraceRecord per event */
+typedef struct {
+	char magic[4];            /* "SXTR" */
+	uint32_t version;
+	uint64_t root;
+} TraceHeader;
+
+typedef struct {
+	uint64_t time;            /* ns since recording started */
+	uint64_t window;
+	uint64_t extra;           /* subwindow, sibling or event window */
+	int32_t type;
+	int32_t v[9];             /* type specific, see trace_record */
+} TraceRecord;
+
+/* restart handoff: one RestartHeader, then a RestartClient per client in workspace list order */
+typedef struct {
+	char magic[4];            /* "SXRS" */
+	uint32_t version;
+	int32_t current_ws;
+	int32_t previous_workspace;
+	int32_t current_mon;
+	int32_t n_clients;
+	int32_t gaps;
+	int32_t monocle;
+	int32_t global_floating;
+	int32_t sp_enabled[MAX_SCRATCHPADS];
+	uint64_t focused;
+	uint64_t ws_focused[NUM_WORKSPACES];
+	uint64_t scratchpads[MAX_SCRATCHPADS];
+	float master_width[MAX_MONITORS];
+} RestartHeader;
+
+typedef struct {
+	uint64_t win;
+	uint64_t swallowed;       /* window this client swallowed, 0 = none */
+	int32_t ws, mon;
+	int32_t x, y, w, h;
+	int32_t orig_x, orig_y, orig_w, orig_h;
+	int32_t custom_stack_height;
+	int32_t stack;            /* position in stack_list, bottom to top */
+	uint8_t fixed, floating, fullscreen, mapped, offscreen, can_swallow;
+} RestartClient;
+
+/* flight recorder dump: one RingHeader, the entries oldest first, then the open ones outermost first */
+typedef struct {
+	char magic[4];            /* "SXRB" */
+	uint32_t version;
+	uint64_t count;           /* finished entries */
+	uint64_t open;            /* entries still running at dump time, end is 0 */
+} RingHeader;
+
+typedef struct {
+	uint64_t start;           /* CLOCK_MONOTONIC ns */
+	uint64_t end;
+	uint32_t window;
+	uint16_t kind;            /* RING_EVENT, RING_TILE or RING_GRAB */
+	uint16_t type;            /* event type for RING_EVENT */
+} RingEntry;
+
+typedef struct {
+	uint64_t from;            /* window id in the trace */
+	Window to;                /* stand-in window */
+} TraceWindow;
+
+typedef struct {
+	pid_t pid;
+	pid_t ppid;
+	unsigned long long start; /* jiffies after boot, tells reused pids apart */
+} ProcEntry;
+
 typedef enum {
 	ATOM_NET_ACTIVE_WINDOW,
 	ATOM_NET_CURRENT_DESKTOP,
 	ATOM_NET_SUPPORTED,
 	ATOM_NET_WM_STATE,
 	ATOM_NET_WM_STATE_FULLSCREEN,
+	ATOM_NET_WM_STATE_HIDDEN,
 	ATOM_WM_STATE,
 	ATOM_NET_WM_WINDOW_TYPE,
 	ATOM_NET_WORKAREA,
@@ -158,6 +365,8 @@ typedef enum {
 	ATOM_NET_WM_WINDOW_TYPE_NOTIFICATION,
 	ATOM_NET_WM_STATE_MODAL,
 	ATOM_WM_PROTOCOLS,
+	ATOM_NET_CLIENT_LIST_STACKING,
+	ATOM_WM_TAKE_FOCUS,
 	ATOM_COUNT
 } AtomType;
 
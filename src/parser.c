@@ -16,6 +16,7 @@
 static Binding *alloc_bind(Config *cfg, unsigned mods, KeySym ks);
 static char **alloc_str_pair(const char *a, const char *b);
 static void dedupe_binds(Config *cfg);
+static void (*find_call(const char *name))(void);
 static int find_free_slot(char **arr[], int max);
 static FILE *open_config(char *path, size_t pathsz);
 static Binding *parse_bind_line(Config *cfg, char *rest, int lineno, const char *ctx, char **out_act);
@@ -53,6 +54,7 @@ static const CommandEntry call_table[] = {
 	{"resize_win_down",           resize_win_down},
 	{"resize_win_left",           resize_win_left},
 	{"resize_win_right",          resize_win_right},
+	{"restart",                   restart},
 	{"stack_increase",            resize_stack_add},
 	{"stack_decrease",            resize_stack_sub},
 	{"switch_previous_workspace", switch_previous_workspace},
@@ -61,6 +63,15 @@ static const CommandEntry call_table[] = {
 	{NULL, NULL},
 };
 
+static const struct {
+	const char *fmt;
+	int type;
+} sp_acts[] = {
+	{"create %d", TYPE_SP_CREATE},
+	{"toggle %d", TYPE_SP_TOGGLE},
+	{"remove %d", TYPE_SP_REMOVE},
+};
+
 static Binding *alloc_bind(Config *cfg, unsigned mods, KeySym ks)
 {
 	for (int i = 0; i < cfg->n_binds; i++) {
@@ -88,14 +99,47 @@ static char **alloc_str_pair(const char *a, const char *b)
 	return p;
 }
 
-const char **build_argv(const char *cmd)
+Command *build_command(const char *cmd)
 {
 	int argc = 0;
-	char **tmp = split_cmd(cmd, &argc);
-	if (!tmp)
+	Command *c = calloc(1, sizeof(Command));
+	if (!c)
 		return NULL;
 
-	return (const char **)tmp;
+	c->args = split_cmd(cmd, &argc);
+	if (!c->args) {
+		free(c);
+		return NULL;
+	}
+
+	/* split the pipeline once here so spawn() never has to */
+	Bool stage_start = True;
+	for (int i = 0; i < argc; i++) {
+		if (!strcmp(c->args[i], "|")) {
+			free(c->args[i]);
+			c->args[i] = NULL;
+			stage_start = True;
+			continue;
+		}
+		if (stage_start) {
+			if (c->n_stages == MAX_PIPELINE) {
+				fprintf(stderr, "sxwmrc: too many pipeline stages in '%s'\n", cmd);
+				c->n_stages = 0;
+				break;
+			}
+			c->stages[c->n_stages++] = &c->args[i];
+			stage_start = False;
+		}
+	}
+
+	if (c->n_stages == 0) {
+		for (int i = 0; i < argc; i++)
+			free(c->args[i]);
+		free(c->args);
+		free(c);
+		return NULL;
+	}
+	return c;
 }
 
 static void dedupe_binds(Config *cfg)
@@ -116,6 +160,14 @@ static void dedupe_binds(Config *cfg)
 	}
 }
 
+static void (*find_call(const char *name))(void)
+{
+	for (int i = 0; call_table[i].name; i++)
+		if (!strcmp(name, call_table[i].name))
+			return call_table[i].fn;
+	return NULL;
+}
+
 static int find_free_slot(char **arr[], int max)
 {
 	for (int i = 0; i < max; i++) {
@@ -126,6 +178,20 @@ static int find_free_slot(char **arr[], int max)
 	return -1;
 }
 
+void free_command(Command *cmd)
+{
+	if (!cmd)
+		return;
+
+	/* stages share args, the NULLs left by "|" end each stage */
+	for (int i = 0; i < cmd->n_stages; i++)
+		for (char **a = cmd->stages[i]; *a; a++)
+			free(*a);
+
+	free(cmd->args);
+	free(cmd);
+}
+
 static FILE *open_config(char *path, size_t pathsz)
 {
 	const char *home = getenv("HOME");
@@ -168,6 +234,48 @@ found:
 	return f;
 }
 
+int parse_action(char *s, Binding *b)
+{
+	char *act = strip(s);
+	unsigned long win;
+	int n;
+
+	b->mods = 0;
+	b->keysym = NoSymbol;
+	b->keycode = 0;
+
+	if (sscanf(act, "workspace move %d", &n) == 1 && n >= 1 && n <= NUM_WORKSPACES) {
+		b->type = TYPE_WS_CHANGE;
+		b->action.ws = n - 1;
+		return 0;
+	}
+	if (sscanf(act, "workspace swap %d", &n) == 1 && n >= 1 && n <= NUM_WORKSPACES) {
+		b->type = TYPE_WS_MOVE;
+		b->action.ws = n - 1;
+		return 0;
+	}
+	if (!strncmp(act, "scratchpad ", 11)) {
+		for (size_t i = 0; i < sizeof(sp_acts) / sizeof(sp_acts[0]); i++) {
+			if (sscanf(act + 11, sp_acts[i].fmt, &n) == 1 && n >= 1 && n <= MAX_SCRATCHPADS) {
+				b->type = sp_acts[i].type;
+				b->action.sp = n - 1;
+				return 0;
+			}
+		}
+		return -1;
+	}
+	if (sscanf(act, "focus %lx", &win) == 1) {
+		b->type = TYPE_FOCUS;
+		b->action.win = win;
+		return 0;
+	}
+	if ((b->action.fn = find_call(act))) {
+		b->type = TYPE_FUNC;
+		return 0;
+	}
+	return -1;
+}
+
 static Binding *parse_bind_line(Config *cfg, char *rest, int lineno, const char *ctx, char **out_act)
 {
 	char *mid = strchr(rest, ':');
@@ -324,7 +432,7 @@ int parser(Config *cfg)
 
 			if (*act == '"' && !strcmp(key, "bind")) {
 				b->type = TYPE_CMD;
-				b->action.cmd = build_argv(strip_quotes(act));
+				b->action.cmd = build_command(strip_quotes(act));
 				if (!b->action.cmd) {
 					fprintf(stderr, "sxwmrc:%d: failed to parse command: %s\n", lineno, act);
 					b->type = -1;
@@ -332,13 +440,7 @@ int parser(Config *cfg)
 			}
 			else {
 				b->type = TYPE_FUNC;
-				b->action.fn = NULL;
-				for (int i = 0; call_table[i].name; i++) {
-					if (!strcmp(act, call_table[i].name)) {
-						b->action.fn = call_table[i].fn;
-						break;
-					}
-				}
+				b->action.fn = find_call(act);
 				if (!b->action.fn)
 					fprintf(stderr, "sxwmrc:%d: unknown function '%s'\n", lineno, act);
 			}
@@ -365,9 +467,11 @@ int parser(Config *cfg)
 				fprintf(stderr, "sxwmrc:%d: empty exec command\n", lineno);
 				continue;
 			}
-			cfg->to_run[to_run] = strdup(cmd);
-			if (!cfg->to_run[to_run])
-				goto cleanup;
+			cfg->to_run[to_run] = build_command(cmd);
+			if (!cfg->to_run[to_run]) {
+				fprintf(stderr, "sxwmrc:%d: failed to parse command: %s\n", lineno, cmd);
+				continue;
+			}
 			to_run++;
 		}
 		else if (!strcmp(key, "floating_on_top"))
@@ -376,6 +480,10 @@ int parser(Config *cfg)
 			cfg->border_foc_col = parse_col(rest);
 		else if (!strcmp(key, "gaps"))
 			cfg->gaps = atoi(rest);
+		else if (!strcmp(key, "handler_timing"))
+			cfg->handler_timing = !strcmp(rest, "true");
+		else if (!strcmp(key, "hide_offscreen"))
+			cfg->hide_offscreen = !strcmp(rest, "true");
 		else if (!strcmp(key, "master_width")) {
 			float mf = (float)atoi(rest) / 100.0f;
 			for (int i = 0; i < MAX_MONITORS; i++)
@@ -429,11 +537,6 @@ int parser(Config *cfg)
 				goto cleanup;
 
 			int n, found = 0;
-			static const struct { const char *fmt; int type; } sp_acts[] = {
-				{"create %d", TYPE_SP_CREATE},
-				{"toggle %d", TYPE_SP_TOGGLE},
-				{"remove %d", TYPE_SP_REMOVE},
-			};
 			for (size_t i = 0; i < sizeof(sp_acts) / sizeof(sp_acts[0]); i++) {
 				if (sscanf(act, sp_acts[i].fmt, &n) == 1 && n >= 1 && n <= MAX_SCRATCHPADS) {
 					b->type = sp_acts[i].type;
@@ -452,6 +555,8 @@ int parser(Config *cfg)
 		}
 		else if (!strcmp(key, "snap_distance"))
 			cfg->snap_distance = atoi(rest);
+		else if (!strcmp(key, "stall_budget"))
+			cfg->stall_budget = atoi(rest);
 		else if (!strcmp(key, "start_fullscreen")) {
 			int idx = find_free_slot(cfg->start_fullscreen, MAX_ITEMS);
 			if (idx < 0)
@@ -519,8 +624,10 @@ cleanup:
 			free(cfg->open_in_workspace[j]);
 		}
 	}
-	for (int i = 0; i < to_run; i++)
-		free(cfg->to_run[i]);
+	for (int i = 0; i < to_run; i++) {
+		free_command(cfg->to_run[i]);
+		cfg->to_run[i] = NULL;
+	}
 
 	return -1;
 }
@@ -2,7 +2,9 @@
 #include "defs.h"
 #define MAX_ARGS 64
 
-const char **build_argv(const char *cmd);
+Command *build_command(const char *cmd);
+void free_command(Command *cmd);
+int parse_action(char *s, Binding *b);
 int parser(Config *user_config);
 int parse_mods(const char *mods, Config *user_config);
 KeySym parse_keysym(const char *key);
@@ -13,13 +13,24 @@
  *  > uint 2025
 */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <X11/keysym.h>
@@ -36,24 +47,65 @@
 #include "extern.h"
 #include "parser.h"
 
-Client *add_client(Window w, int ws);
+/* blocking Xlib calls are counted and timed per call site, see rt_end */
+#define RT_WRAP(call)               (rt_begin(), rt_end(__func__, __LINE__, (long)(call)))
+#define XAllocColor(...)            RT_WRAP(XAllocColor(__VA_ARGS__))
+#define XGetClassHint(...)          RT_WRAP(XGetClassHint(__VA_ARGS__))
+#define XGetTransientForHint(...)   RT_WRAP(XGetTransientForHint(__VA_ARGS__))
+#define XGetWindowAttributes(...)   RT_WRAP(XGetWindowAttributes(__VA_ARGS__))
+#define XGetWindowProperty(...)     RT_WRAP(XGetWindowProperty(__VA_ARGS__))
+#define XGetWMNormalHints(...)      RT_WRAP(XGetWMNormalHints(__VA_ARGS__))
+#define XGetWMProtocols(...)        RT_WRAP(XGetWMProtocols(__VA_ARGS__))
+#define XGrabPointer(...)           RT_WRAP(XGrabPointer(__VA_ARGS__))
+#define XInternAtom(...)            (Atom)RT_WRAP(XInternAtom(__VA_ARGS__))
+#define XQueryPointer(...)          RT_WRAP(XQueryPointer(__VA_ARGS__))
+#define XQueryTree(...)             RT_WRAP(XQueryTree(__VA_ARGS__))
+#define XSync(d, discard)           (stats.syncs++, RT_WRAP(XSync((d), (discard))))
+
+/* USDT probes for bpftrace/perf, a nop each wherever sys/sdt.h is installed */
+#if !defined(SXWM_USDT) && !defined(SXWM_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define SXWM_USDT
+#endif
+#endif
+
+#ifdef SXWM_USDT
+#include <sys/sdt.h>
+#define PROBE1(name, a)             DTRACE_PROBE1(sxwm, name, a)
+#define PROBE2(name, a, b)          DTRACE_PROBE2(sxwm, name, a, b)
+#define PROBE3(name, a, b, c)       DTRACE_PROBE3(sxwm, name, a, b, c)
+#else
+#define PROBE1(name, a)             ((void)0)
+#define PROBE2(name, a, b)          ((void)0)
+#define PROBE3(name, a, b, c)       ((void)0)
+#endif
+
+Client *add_client(Window w, int ws, XWindowAttributes *wa);
 void apply_fullscreen(Client *c, Bool on);
+void batch_begin(void);
+void batch_commit(void);
 /* void centre_window(void); */
 void change_workspace(int ws);
 int check_parent(pid_t p, pid_t c);
 int clean_mask(int mask);
+Bool client_has_state(Client *c, Atom state);
+void client_list_add(Client *c);
+void client_list_remove(Client *c);
+void client_load_state(Client *c);
+void client_set_state(Client *c, Atom state, Bool add);
 /* void close_focused(void); */
+void configure_client(Client *c, XWindowChanges *wc);
 /* void dec_gaps(void); */
 Client *find_client(Window w);
+Client *find_swallower(Client *c);
 Window find_toplevel(Window w);
 /* void focus_next(void); */
 /* void focus_prev(void); */
 /* void focus_next_mon(void); */
 /* void focus_prev_mon(void); */
 int get_monitor_for(Client *c);
-pid_t get_parent_process(pid_t c);
 pid_t get_pid(Window w);
-int get_workspace_for_window(Window w);
+int get_workspace_for_window(XClassHint *ch);
 void grab_button(Mask button, Mask mod, Window w, Bool owner_events, Mask masks);
 void grab_keys(void);
 void hdl_button(XEvent *xev);
@@ -61,6 +113,7 @@ void hdl_button_release(XEvent *xev);
 void hdl_client_msg(XEvent *xev);
 void hdl_config_ntf(XEvent *xev);
 void hdl_config_req(XEvent *xev);
+void hdl_crossing(XEvent *xev);
 void hdl_dummy(XEvent *xev);
 void hdl_destroy_ntf(XEvent *xev);
 void hdl_keypress(XEvent *xev);
@@ -69,9 +122,36 @@ void hdl_map_req(XEvent *xev);
 void hdl_motion(XEvent *xev);
 void hdl_property_ntf(XEvent *xev);
 void hdl_unmap_ntf(XEvent *xev);
+void hide_client(Client *c);
+unsigned long hist_percentile(int type, double q);
 /* void inc_gaps(void); */
 void init_defaults(void);
+void ipc_accept(void);
+void ipc_batch(char *steps);
+void ipc_cleanup(void);
+int ipc_client(int ac, char **av);
+void ipc_close(IpcConn *ic);
+void ipc_flush(IpcConn *ic);
+void ipc_handle(IpcConn *ic, char *req);
+void ipc_init(void);
+void ipc_notify(unsigned int events);
+void ipc_poll(void);
+void ipc_print_events(unsigned int events);
+void ipc_printf(const char *fmt, ...);
+void ipc_publish(void);
+void ipc_query_clients(void);
+void ipc_query_monitors(void);
+void ipc_query_roundtrips(void);
+void ipc_query_scratchpads(void);
+void ipc_query_state(void);
+void ipc_read(IpcConn *ic);
+Bool ipc_send(IpcConn *ic, const char *msg, size_t len);
+void ipc_subscribe(IpcConn *ic, char *topics);
 Bool is_child_proc(pid_t pid1, pid_t pid2);
+Bool is_dock(Window w);
+uint64_t layout_hash(void);
+void manage_window(Window w, XWindowAttributes *wa);
+Bool match_class(XClassHint *ch, char **rules[]);
 /* void move_master_next(void); */
 /* void move_master_prev(void); */
 /* void move_next_mon(void); */
@@ -81,10 +161,16 @@ void move_to_workspace(int ws);
 /* void move_win_left(void); */
 /* void move_win_right(void); */
 /* void move_win_up(void); */
+unsigned long long now_ns(void);
 void other_wm(void);
 int other_wm_err(Display *d, XErrorEvent *ee);
 /* long parse_col(const char *hex); */
+Bool proc_lookup(pid_t pid, unsigned long long born_before, Bool fresh, ProcEntry *out);
+int proc_walk(pid_t p, pid_t c, Bool fresh);
 /* void quit(void); */
+void raise_client(Client *c);
+Bool read_full(int fd, void *buf, size_t len);
+int read_proc_stat(pid_t pid, ProcEntry *pe);
 /* void reload_config(void); */
 void remove_scratchpad(int n);
 /* void resize_master_add(void); */
@@ -95,30 +181,75 @@ void remove_scratchpad(int n);
 /* void resize_win_left(void); */
 /* void resize_win_right(void); */
 /* void resize_win_up(void); */
+void restack(void);
+/* void restart(void); */
+Bool restart_restore(const char *path);
+Bool restart_save(const char *path);
+void ring_begin(int kind, int type, Window w, unsigned long long start);
+Bool ring_dump(void);
+void ring_init(void);
+int ring_json(const char *path);
+const char *ring_name(int kind, int type);
+void ring_push(int kind, int type, Window w, unsigned long long start);
+void rt_begin(void);
+long rt_end(const char *func, int line, long ret);
 void run(void);
+void runtime_path(char *buf, size_t size, const char *ext);
+void run_binding(const Binding *b);
 void reset_opacity(Window w);
 void scan_existing_windows(void);
 void select_input(Window w, Mask masks);
-void send_wm_take_focus(Window w);
+void send_wm_take_focus(Client *c);
 void setup(void);
 void setup_atoms(void);
+void set_active_window(Window w);
+void set_border_colour(Client *c, long col);
+void set_client_desktop(Client *c, int ws);
 void set_frame_extents(Window w);
 void set_input_focus(Client *c, Bool raise_win, Bool warp);
 void set_opacity(Window w, double opacity);
 void set_win_scratchpad(int n);
 void set_wm_state(Window w, long state);
+void show_client(Client *c);
+void sig_ring(int sig);
+void sig_stall(int sig);
+void sig_stats(int sig);
+void snapshot_cleanup(void);
+void snapshot_init(void);
+void snapshot_publish(void);
 int snap_coordinate(int pos, int size, int screen_size, int snap_dist);
-void spawn(const char * const *argv);
+void spawn(const Command *cmd);
+size_t stall_append(char *buf, size_t n, size_t size, const char *s);
+size_t stall_append_num(char *buf, size_t n, size_t size, unsigned long long v, int base);
+void stall_arm(void);
+void stall_check(const char *what, Window w, unsigned long long start);
+void stall_disarm(void);
 void startup_exec(void);
+void startup_phase(const char *what, Window w);
+void stats_dump(void);
+void stats_format(void);
+void stats_json(unsigned long n, double elapsed_ms);
+void swallow_index_add(Client *c);
+void swallow_index_rebuild(void);
+void swallow_index_remove(Client *c);
 void swallow_window(Client *swallower, Client *swallowed);
 void swap_clients(Client *a, Client *b);
 /* void switch_previous_workspace(void); */
 void tile(void);
+void tile_idle(void);
+void tile_ws(int ws);
 /* void toggle_floating(void); */
 /* void toggle_floating_global(void); */
 /* void toggle_fullscreen(void); */
 /* void toggle_monocle(void); */
 void toggle_scratchpad(int n);
+Atom trace_decode_atom(int32_t v);
+int32_t trace_encode_atom(Atom a);
+void trace_event(const TraceRecord *r, XEvent *xev);
+void trace_record(XEvent *xev);
+int trace_replay(const char *path);
+void trace_start(const char *path);
+Window trace_window(uint64_t id);
 void unswallow_window(Client *c);
 void update_borders(void);
 void update_client_desktop_properties(void);
@@ -128,10 +259,8 @@ void update_net_client_list(void);
 void update_struts(void);
 void update_workarea(void);
 void warp_cursor(Client *c);
-Bool window_has_ewmh_state(Window w, Atom state);
-void window_set_ewmh_state(Window w, Atom state, Bool add);
-Bool window_should_float(Window w);
-Bool window_should_start_fullscreen(Window w);
+Bool window_should_float(XClassHint *ch);
+Bool window_should_start_fullscreen(XClassHint *ch);
 int xerr(Display *d, XErrorEvent *ee);
 void xev_case(XEvent *xev);
 
@@ -142,6 +271,7 @@ static const char *atom_names[ATOM_COUNT] = {
 	[ATOM_NET_SUPPORTED]                 = "_NET_SUPPORTED",
 	[ATOM_NET_WM_STATE]                  = "_NET_WM_STATE",
 	[ATOM_NET_WM_STATE_FULLSCREEN]       = "_NET_WM_STATE_FULLSCREEN",
+	[ATOM_NET_WM_STATE_HIDDEN]           = "_NET_WM_STATE_HIDDEN",
 	[ATOM_WM_STATE]                      = "WM_STATE",
 	[ATOM_NET_WM_WINDOW_TYPE]            = "_NET_WM_WINDOW_TYPE",
 	[ATOM_NET_WORKAREA]                  = "_NET_WORKAREA",
@@ -169,6 +299,45 @@ static const char *atom_names[ATOM_COUNT] = {
 	[ATOM_NET_WM_WINDOW_TYPE_NOTIFICATION] = "_NET_WM_WINDOW_TYPE_NOTIFICATION",
 	[ATOM_NET_WM_STATE_MODAL]            = "_NET_WM_STATE_MODAL",
 	[ATOM_WM_PROTOCOLS]                  = "WM_PROTOCOLS",
+	[ATOM_NET_CLIENT_LIST_STACKING]      = "_NET_CLIENT_LIST_STACKING",
+	[ATOM_WM_TAKE_FOCUS]                 = "WM_TAKE_FOCUS",
+};
+
+static const char *event_names[LASTEvent] = {
+	[KeyPress]         = "KeyPress",
+	[KeyRelease]       = "KeyRelease",
+	[ButtonPress]      = "ButtonPress",
+	[ButtonRelease]    = "ButtonRelease",
+	[MotionNotify]     = "MotionNotify",
+	[EnterNotify]      = "EnterNotify",
+	[LeaveNotify]      = "LeaveNotify",
+	[FocusIn]          = "FocusIn",
+	[FocusOut]         = "FocusOut",
+	[KeymapNotify]     = "KeymapNotify",
+	[Expose]           = "Expose",
+	[GraphicsExpose]   = "GraphicsExpose",
+	[NoExpose]         = "NoExpose",
+	[VisibilityNotify] = "VisibilityNotify",
+	[CreateNotify]     = "CreateNotify",
+	[DestroyNotify]    = "DestroyNotify",
+	[UnmapNotify]      = "UnmapNotify",
+	[MapNotify]        = "MapNotify",
+	[MapRequest]       = "MapRequest",
+	[ReparentNotify]   = "ReparentNotify",
+	[ConfigureNotify]  = "ConfigureNotify",
+	[ConfigureRequest] = "ConfigureRequest",
+	[GravityNotify]    = "GravityNotify",
+	[ResizeRequest]    = "ResizeRequest",
+	[CirculateNotify]  = "CirculateNotify",
+	[CirculateRequest] = "CirculateRequest",
+	[PropertyNotify]   = "PropertyNotify",
+	[SelectionClear]   = "SelectionClear",
+	[SelectionRequest] = "SelectionRequest",
+	[SelectionNotify]  = "SelectionNotify",
+	[ColormapNotify]   = "ColormapNotify",
+	[ClientMessage]    = "ClientMessage",
+	[MappingNotify]    = "MappingNotify",
+	[GenericEvent]     = "GenericEvent",
 };
 
 Cursor cursor_normal;
@@ -182,12 +351,26 @@ Client *drag_client = NULL;
 Client *swap_target = NULL;
 Client *focused = NULL;
 Client *ws_focused[NUM_WORKSPACES] = {NULL};
+Bool ws_dirty[NUM_WORKSPACES] = {False};
+uint64_t ws_layout_hash = 0; /* layout inputs hidden workspaces were last marked for */
 EventHandler evtable[LASTEvent];
 Display *dpy;
 Window root;
 Window wm_check_win;
 Monitor *mons = NULL;
 Scratchpad scratchpads[MAX_SCRATCHPADS];
+ProcEntry proc_cache[PROC_CACHE_SIZE];
+Client *swallow_index[SWALLOW_INDEX_SIZE];
+IpcConn ipc_conns[IPC_MAX_CONNS];
+char ipc_path[PATH_MAX];
+char ipc_msg[IPC_OUT_SIZE - sizeof(uint32_t)];
+size_t ipc_msg_len = 0;
+unsigned int ipc_pending = 0;
+int ipc_fd = -1;
+Snapshot *snapshot = NULL;
+Snapshot snapshot_next;
+char snapshot_path[PATH_MAX];
+int proc_fd = -1;
 int scratchpad_count = 0;
 int current_scratchpad = 0;
 int n_mons = 0;
@@ -198,7 +381,48 @@ long last_motion_time = 0;
 Bool global_floating = False;
 Bool in_ws_switch = False;
 Bool running = False;
+Bool batching = False;
+unsigned int deferred = 0;
+Stats stats = {0};
+volatile sig_atomic_t stats_requested = 0;
+RoundTripSite rt_sites[RT_MAX_SITES];
+int rt_n_sites = 0;
+int rt_event = 0; /* event type being handled, 0 outside of handlers */
+unsigned long long rt_start = 0;
+FILE *trace_file = NULL;
+unsigned long long trace_start_ns = 0;
+uint64_t trace_root = 0;
+TraceWindow trace_windows[TRACE_WIN_SLOTS];
+Bool replaying = False;
+RingEntry ring[RING_SIZE];
+unsigned long ring_head = 0; /* entries ever pushed */
+RingEntry ring_open[RING_DEPTH]; /* spans begun and not yet pushed, outermost first */
+volatile sig_atomic_t ring_depth = 0;
+int stall_armed = 0; /* nested stall_arm calls, the timer runs for the outermost */
+char ring_path[PATH_MAX];
+int ring_fd = -1; /* opened by ring_init, signal handlers only write to it */
+unsigned long long startup_start = 0; /* set by --trace-startup */
+unsigned long long startup_last = 0;
+unsigned long startup_requests = 0;
+unsigned long startup_rt = 0;
+char **restart_argv = NULL;
 Bool monocle = False;
+Window client_list[MAX_CLIENTS]; /* mapping order, oldest first */
+int client_list_n = 0;
+int client_list_pub = 0; /* entries already on the root property */
+Bool client_list_stale = True; /* replace rather than append */
+Client *stack_list[MAX_CLIENTS]; /* raise order within layers, bottom to top */
+int stack_n = 0;
+Window stack_pub[MAX_CLIENTS]; /* order last applied by restack */
+int stack_pub_n = 0;
+Bool stack_dirty = True; /* stack_pub not yet on the root property */
+Bool restack_needed = False;
+Window active_pub = (Window)-1; /* _NET_ACTIVE_WINDOW as last written, -1 unknown */
+int desktop_echoes = 0; /* our _NET_CURRENT_DESKTOP writes not yet notified */
+Bool struts_stale = True; /* a dock or monitor changed since update_struts */
+Window docks[MAX_DOCKS]; /* docks found by the last update_struts */
+int n_docks = 0;
+int ptr_x = -1, ptr_y = -1; /* last pointer position seen in events */
 
 Mask numlock_mask = 0;
 Mask mode_switch_mask = 0;
@@ -209,12 +433,14 @@ int open_windows = 0;
 int drag_start_x, drag_start_y;
 int drag_orig_x, drag_orig_y, drag_orig_w, drag_orig_h;
 
+extern char **environ;
+
 int reserve_left = 0;
 int reserve_right = 0;
 int reserve_top = 0;
 int reserve_bottom = 0;
 
-Client *add_client(Window w, int ws)
+Client *add_client(Window w, int ws, XWindowAttributes *wa)
 {
 	Client *c = malloc(sizeof(Client));
 	if (!c) {
@@ -228,6 +454,7 @@ Client *add_client(Window w, int ws)
 	c->pid = get_pid(w);
 	c->swallowed = NULL;
 	c->swallower = NULL;
+	c->swallow_next = NULL;
 
 	if (!workspaces[ws]) {
 		workspaces[ws] = c;
@@ -259,12 +486,10 @@ Client *add_client(Window w, int ws)
 	Atom protos[] = {atoms[ATOM_WM_DELETE_WINDOW]};
 	XSetWMProtocols(dpy, w, protos, 1);
 
-	XWindowAttributes wa;
-	XGetWindowAttributes(dpy, w, &wa);
-	c->x = wa.x;
-	c->y = wa.y;
-	c->w = wa.width;
-	c->h = wa.height;
+	c->x = wa->x;
+	c->y = wa->y;
+	c->w = wa->width;
+	c->h = wa->height;
 
 	/* set monitor based on cursor location */
 	Window root_ret, child_ret;
@@ -292,7 +517,14 @@ Client *add_client(Window w, int ws)
 	c->floating = False;
 	c->fullscreen = False;
 	c->mapped = True;
+	c->offscreen = False;
 	c->custom_stack_height = 0;
+	c->n_states = -1;
+	c->state_echoes = 0;
+	c->state_set = False;
+	c->take_focus = 0; /* WM_PROTOCOLS was just replaced with WM_DELETE_WINDOW */
+	c->protocols_echo = True;
+	c->border_col = -1;
 
 	if (global_floating)
 		c->floating = True;
@@ -306,11 +538,14 @@ Client *add_client(Window w, int ws)
 		current_mon = c->mon;
 	}
 
+	stats.clients_added++;
+	ipc_notify(IPC_EV_CLIENT_ADD);
+
 	/* associate client with workspace n */
-	long desktop = ws;
-	XChangeProperty(dpy, w, atoms[ATOM_NET_WM_DESKTOP], XA_CARDINAL, 32,
-			        PropModeReplace, (unsigned char *)&desktop, 1);
-	XRaiseWindow(dpy, w);
+	c->desktop = -1;
+	set_client_desktop(c, ws);
+	client_list_add(c);
+	raise_client(c);
 	return c;
 }
 
@@ -319,39 +554,41 @@ void apply_fullscreen(Client *c, Bool on)
 	if (!c || !c->mapped || c->fullscreen == on)
 		return;
 
+	/* the layout of a hidden workspace changes with it */
+	if (c->ws != current_ws)
+		ws_dirty[c->ws] = True;
 
 	if (on) {
-		XWindowAttributes win_attr;
-		if (!XGetWindowAttributes(dpy, c->win, &win_attr))
-			return;
-
-		c->orig_x = win_attr.x;
-		c->orig_y = win_attr.y;
-		c->orig_w = win_attr.width;
-		c->orig_h = win_attr.height;
+		/* geometry is tracked on every configure, no need to ask the server */
+		c->orig_x = c->x;
+		c->orig_y = c->y;
+		c->orig_w = c->w;
+		c->orig_h = c->h;
 
 		c->fullscreen = True;
 
 		int mon = CLAMP(c->mon, 0, n_mons - 1);
-		/* make window fill mon */
-		XSetWindowBorderWidth(dpy, c->win, 0);
-		XMoveResizeWindow(dpy, c->win, mons[mon].x, mons[mon].y, mons[mon].w, mons[mon].h);
+		/* make window fill mon, geometry and border in one request */
+		XWindowChanges wc = {.x = mons[mon].x, .y = mons[mon].y, .width = mons[mon].w,
+		                     .height = mons[mon].h, .border_width = 0};
+		XConfigureWindow(dpy, c->win, CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &wc);
 
 		c->x = mons[mon].x;
 		c->y = mons[mon].y;
 		c->w = mons[mon].w;
 		c->h = mons[mon].h;
 
-		XRaiseWindow(dpy, c->win);
-		window_set_ewmh_state(c->win, atoms[ATOM_NET_WM_STATE_FULLSCREEN], True);
+		raise_client(c);
+		client_set_state(c, atoms[ATOM_NET_WM_STATE_FULLSCREEN], True);
 	}
 	else {
 		c->fullscreen = False;
 
 		/* restore win attributes */
-		XMoveResizeWindow(dpy, c->win, c->orig_x, c->orig_y, c->orig_w, c->orig_h);
-		XSetWindowBorderWidth(dpy, c->win, user_config.border_width);
-		window_set_ewmh_state(c->win, atoms[ATOM_NET_WM_STATE_FULLSCREEN], False);
+		XWindowChanges wc = {.x = c->orig_x, .y = c->orig_y, .width = c->orig_w, .height = c->orig_h,
+		                     .border_width = user_config.border_width};
+		XConfigureWindow(dpy, c->win, CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &wc);
+		client_set_state(c, atoms[ATOM_NET_WM_STATE_FULLSCREEN], False);
 
 		c->x = c->orig_x;
 		c->y = c->orig_y;
@@ -365,6 +602,35 @@ void apply_fullscreen(Client *c, Bool on)
 	}
 }
 
+void batch_begin(void)
+{
+	batching = True;
+	deferred = 0;
+}
+
+void batch_commit(void)
+{
+	unsigned int work = deferred;
+
+	batching = False;
+	deferred = 0;
+	if (!running)
+		return;
+
+	/* everything the batch asked for, once */
+	if (work & DEFER_TILE)
+		tile();
+	if (work & DEFER_BORDERS)
+		update_borders();
+	if (work & DEFER_RESTACK)
+		restack();
+	if (work & DEFER_CLIENT_LIST)
+		update_net_client_list();
+	if (work & DEFER_DESKTOPS)
+		update_client_desktop_properties();
+	XFlush(dpy);
+}
+
 void centre_window(void)
 {
 	if (!focused || !focused->mapped || !focused->floating)
@@ -385,12 +651,15 @@ void change_workspace(int ws)
 {
 	if (ws >= NUM_WORKSPACES || ws == current_ws)
 		return;
+	PROBE2(workspace, current_ws, ws);
 
 	/* remember last focus for workspace we are leaving */
 	ws_focused[current_ws] = focused;
 
 	in_ws_switch = True;
 	XGrabServer(dpy); /* freeze rendering for tearless switching */
+	unsigned long long grab_start = now_ns();
+	ring_begin(RING_GRAB, 0, None, grab_start);
 
 	/* scratchpads stay visible */
 	Bool visible_scratchpads[MAX_SCRATCHPADS] = {False};
@@ -413,7 +682,7 @@ void change_workspace(int ws)
 				}
 			}
 			if (!is_scratchpad)
-				XUnmapWindow(dpy, c->win);
+				hide_client(c);
 		}
 	}
 
@@ -430,7 +699,7 @@ void change_workspace(int ws)
 				}
 			}
 			if (!is_scratchpad)
-				XMapWindow(dpy, c->win);
+				show_client(c);
 		}
 	}
 
@@ -446,6 +715,7 @@ void change_workspace(int ws)
 
 			if (*pp)
 				*pp = c->next;
+			ws_dirty[c->ws] = True;
 
 			/* add to new workspace */
 			c->next = workspaces[current_ws];
@@ -454,18 +724,15 @@ void change_workspace(int ws)
 
 			XMapWindow(dpy, c->win);
 			c->mapped = True;
-			XRaiseWindow(dpy, c->win);
+			raise_client(c);
 
 			/* Update desktop property */
-			long desktop = current_ws;
-			XChangeProperty(dpy, c->win, atoms[ATOM_NET_WM_DESKTOP], XA_CARDINAL, 32,
-					        PropModeReplace, (unsigned char *)&desktop, 1);
+			set_client_desktop(c, current_ws);
 		}
 	}
 
-	tile();
-
-	/* restore last focused client for this workspace */
+	/* restore last focused client for this workspace, before tile so borders are painted once
+	 * and monocle raises a client of this workspace */
 	focused = ws_focused[current_ws];
 
 	if (focused) {
@@ -504,24 +771,31 @@ void change_workspace(int ws)
 		}
 	}
 
+	tile();
 	set_input_focus(focused, False, True);
 
 	long current_desktop = current_ws;
 	XChangeProperty(dpy, root, atoms[ATOM_NET_CURRENT_DESKTOP], XA_CARDINAL, 32,
                     PropModeReplace, (unsigned char *)&current_desktop, 1);
+	desktop_echoes++;
 	update_client_desktop_properties();
 
 	XUngrabServer(dpy);
 	XSync(dpy, False);
+	stats.grabs++;
+	stats.grab_ns += now_ns() - grab_start;
+	ring_push(RING_GRAB, 0, None, grab_start);
 	in_ws_switch = False;
+	ipc_notify(IPC_EV_WORKSPACE);
 }
 
 int check_parent(pid_t p, pid_t c)
 {
-	while (p != c && c != 0) /* walk proc tree until parent found */
-		c = get_parent_process(c);
+	/* trust the cache first, only a hit is confirmed against /proc */
+	if (!proc_walk(p, c, False))
+		return 0;
 
-	return (int)c;
+	return proc_walk(p, c, True);
 }
 
 int clean_mask(int mask)
@@ -529,6 +803,109 @@ int clean_mask(int mask)
 	return mask & ~(LockMask | numlock_mask | mode_switch_mask);
 }
 
+Bool client_has_state(Client *c, Atom state)
+{
+	if (c->n_states < 0)
+		client_load_state(c);
+
+	for (int i = 0; i < c->n_states; i++)
+		if (c->states[i] == state)
+			return True;
+
+	return False;
+}
+
+void client_list_add(Client *c)
+{
+	if (client_list_n >= MAX_CLIENTS)
+		return;
+
+	client_list[client_list_n++] = c->win;
+	/* new windows go on top of their layer */
+	stack_list[stack_n++] = c;
+}
+
+void client_list_remove(Client *c)
+{
+	for (int i = 0; i < client_list_n; i++) {
+		if (client_list[i] == c->win) {
+			memmove(&client_list[i], &client_list[i + 1], (client_list_n - i - 1) * sizeof(Window));
+			client_list_n--;
+			client_list_stale = True;
+			break;
+		}
+	}
+	for (int i = 0; i < stack_n; i++) {
+		if (stack_list[i] == c) {
+			memmove(&stack_list[i], &stack_list[i + 1], (stack_n - i - 1) * sizeof(Client *));
+			stack_n--;
+			break;
+		}
+	}
+	/* the rest keep their relative order, so no restack is needed */
+	for (int i = 0; i < stack_pub_n; i++) {
+		if (stack_pub[i] == c->win) {
+			memmove(&stack_pub[i], &stack_pub[i + 1], (stack_pub_n - i - 1) * sizeof(Window));
+			stack_pub_n--;
+			stack_dirty = True;
+			break;
+		}
+	}
+}
+
+void client_load_state(Client *c)
+{
+	Atom type;
+	int format;
+	unsigned long n_atoms = 0;
+	unsigned long unread = 0;
+	Atom *found_atoms = NULL;
+
+	c->n_states = 0;
+	c->state_set = False;
+	if (XGetWindowProperty(dpy, c->win, atoms[ATOM_NET_WM_STATE], 0, 1024, False, XA_ATOM, &type,
+		&format, &n_atoms, &unread, (unsigned char**)&found_atoms) == Success) {
+		c->state_set = type != None;
+		for (unsigned long i = 0; found_atoms && i < n_atoms && c->n_states < MAX_NET_STATES; i++)
+			c->states[c->n_states++] = found_atoms[i];
+		if (found_atoms)
+			XFree(found_atoms);
+	}
+}
+
+void client_set_state(Client *c, Atom state, Bool add)
+{
+	/* after mapping only the wm writes _NET_WM_STATE, so the cache stays true */
+	if (client_has_state(c, state) == add)
+		return;
+
+	if (add) {
+		if (c->n_states >= MAX_NET_STATES)
+			return;
+		c->states[c->n_states++] = state;
+	}
+	else {
+		int n = 0;
+		for (int i = 0; i < c->n_states; i++)
+			if (c->states[i] != state)
+				c->states[n++] = c->states[i];
+		c->n_states = n;
+	}
+
+	/* deleting a property that is already gone is not notified */
+	if (c->n_states == 0 && c->state_set) {
+		XDeleteProperty(dpy, c->win, atoms[ATOM_NET_WM_STATE]);
+		c->state_set = False;
+		c->state_echoes++;
+	}
+	else if (c->n_states > 0) {
+		XChangeProperty(dpy, c->win, atoms[ATOM_NET_WM_STATE], XA_ATOM, 32, PropModeReplace,
+		                (unsigned char *)c->states, c->n_states);
+		c->state_set = True;
+		c->state_echoes++;
+	}
+}
+
 void close_focused(void)
 {
 	if (!focused)
@@ -568,6 +945,23 @@ void close_focused(void)
 	XKillClient(dpy, focused->win);
 }
 
+void configure_client(Client *c, XWindowChanges *wc)
+{
+	Mask mask = CWX | CWY | CWWidth | CWHeight | CWBorderWidth;
+
+	/* clients hidden off-screen take their new size, parked clear of the screen */
+	if (c->offscreen) {
+		XWindowChanges parked = *wc;
+		parked.x = -(wc->width + 2 * wc->border_width);
+		stats.configures++;
+		XConfigureWindow(dpy, c->win, mask & ~CWY, &parked);
+		return;
+	}
+
+	stats.configures++;
+	XConfigureWindow(dpy, c->win, mask, wc);
+}
+
 void dec_gaps(void)
 {
 	if (user_config.gaps > 0) {
@@ -587,11 +981,39 @@ Client *find_client(Window w)
 	return NULL;
 }
 
+Client *find_swallower(Client *c)
+{
+	ProcEntry e;
+	pid_t pid = c->pid;
+	unsigned long long born = (unsigned long long)-1;
+
+	/* look every ancestor up in the index instead of asking every client */
+	for (int depth = 0; depth <= PROC_MAX_DEPTH && pid > 1; depth++) {
+		for (Client *p = swallow_index[(unsigned)pid % SWALLOW_INDEX_SIZE]; p; p = p->swallow_next) {
+			if (p->pid != pid || p == c || p->swallowed || !p->mapped || p->ws != current_ws)
+				continue;
+			/* the walk so far may have used cached hops, confirm it */
+			if (proc_walk(p->pid, c->pid, True))
+				return p;
+		}
+
+		if (!proc_lookup(pid, born, depth == 0, &e))
+			break;
+		pid = e.ppid;
+		born = e.start;
+	}
+	return NULL;
+}
+
 Window find_toplevel(Window w)
 {
 	if (!w || w == None)
 		return root;
 
+	/* sxwm never reparents, so managed windows are their own top level */
+	if (w == root || find_client(w))
+		return w;
+
 	Window root_win = None;
 	Window parent;
 	Window *kids;
@@ -698,7 +1120,8 @@ void focus_next_mon(void)
 		int center_x = mons[target_mon].x + mons[target_mon].w / 2;
 		int center_y = mons[target_mon].y + mons[target_mon].h / 2;
 		XWarpPointer(dpy, None, root, 0, 0, 0, 0, center_x, center_y);
-		XSync(dpy, False);
+		ptr_x = center_x;
+		ptr_y = center_y;
 	}
 }
 
@@ -728,7 +1151,8 @@ void focus_prev_mon(void)
 		int center_x = mons[target_mon].x + mons[target_mon].w / 2;
 		int center_y = mons[target_mon].y + mons[target_mon].h / 2;
 		XWarpPointer(dpy, None, root, 0, 0, 0, 0, center_x, center_y);
-		XSync(dpy, False);
+		ptr_x = center_x;
+		ptr_y = center_y;
 	}
 }
 
@@ -749,22 +1173,6 @@ int get_monitor_for(Client *c)
 	return 0;
 }
 
-pid_t get_parent_process(pid_t c)
-{
-	pid_t v = -1;
-	FILE *f;
-	char buf[256];
-
-	snprintf(buf, sizeof(buf), "/proc/%u/stat", (unsigned)c);
-	if (!(f = fopen(buf, "r")))
-		return 0;
-
-	int no_error = fscanf(f, "%*u %*s %*c %d", &v);
-	(void)no_error;
-	fclose(f);
-	return (pid_t)v;
-}
-
 pid_t get_pid(Window w)
 {
 	pid_t pid = 0;
@@ -782,12 +1190,8 @@ pid_t get_pid(Window w)
 	return pid;
 }
 
-int get_workspace_for_window(Window w)
+int get_workspace_for_window(XClassHint *ch)
 {
-	XClassHint ch = {0};
-	if (!XGetClassHint(dpy, w, &ch))
-		return current_ws;
-
 	for (int i = 0; i < MAX_ITEMS; i++) {
 		/* TODO: Add docs for open_in_workspace */
 		if (!user_config.open_in_workspace[i])
@@ -797,18 +1201,12 @@ int get_workspace_for_window(Window w)
 		char *rule_ws = user_config.open_in_workspace[i][1];
 
 		if (rule_class && rule_ws) {
-			if ((ch.res_class && strcasecmp(ch.res_class, rule_class) == 0) ||
-			    (ch.res_name && strcasecmp(ch.res_name, rule_class) == 0)) {
-				XFree(ch.res_class);
-				XFree(ch.res_name);
+			if ((ch->res_class && strcasecmp(ch->res_class, rule_class) == 0) ||
+			    (ch->res_name && strcasecmp(ch->res_name, rule_class) == 0))
 				return atoi(rule_ws);
-			}
 		}
 	}
 
-	XFree(ch.res_class);
-	XFree(ch.res_name);
-
 	return current_ws; /* default */
 }
 
@@ -883,7 +1281,7 @@ void hdl_button(XEvent *xev)
 					     GrabModeAsync, GrabModeAsync, None, cursor_move, CurrentTime);
 			focused = c;
 			set_input_focus(focused, False, False);
-			XSetWindowBorder(dpy, c->win, user_config.border_swap_col);
+			set_border_colour(c, user_config.border_swap_col);
 			return;
 		}
 
@@ -936,8 +1334,8 @@ void hdl_button_release(XEvent *xev)
 
 	if (drag_mode == DRAG_SWAP) {
 		if (swap_target) {
-			XSetWindowBorder(dpy, swap_target->win, (swap_target == focused ?
-						     user_config.border_foc_col : user_config.border_ufoc_col));
+			set_border_colour(swap_target, swap_target == focused ?
+			                  user_config.border_foc_col : user_config.border_ufoc_col);
 			swap_clients(drag_client, swap_target);
 		}
 		tile();
@@ -988,7 +1386,7 @@ void hdl_client_msg(XEvent *xev)
 				apply_fullscreen(c, want);
 
 				if (want)
-					XRaiseWindow(dpy, c->win);
+					raise_client(c);
 			}
 			/* TODO: other states */
 		}
@@ -1015,7 +1413,48 @@ void hdl_config_req(XEvent *xev)
 			if (c->win == config_ev->window)
 				break;
 
+	if (c && c->offscreen && (c->floating || c->fullscreen)) {
+		/* remember the geometry but keep the window off-screen until shown */
+		Mask size = 0;
+		if (!c->fullscreen) {
+			if (config_ev->value_mask & CWX)
+				c->x = config_ev->x;
+			if (config_ev->value_mask & CWY)
+				c->y = config_ev->y;
+			if (config_ev->value_mask & CWWidth)
+				c->w = config_ev->width;
+			if (config_ev->value_mask & CWHeight)
+				c->h = config_ev->height;
+			size = config_ev->value_mask & (CWWidth | CWHeight);
+		}
+
+		/* fullscreen keeps the monitor size as it does on screen, it is only parked again;
+		 * a wider window must be parked further left to stay hidden */
+		XWindowChanges wc = { .x = -(c->w + 2 * user_config.border_width), .width = c->w, .height = c->h };
+		XConfigureWindow(dpy, c->win, CWX | size, &wc);
+		return;
+	}
+
 	if (!c || c->floating || c->fullscreen) {
+		Mask mask = config_ev->value_mask;
+		if (c) {
+			/* keep the cached geometry true, it is used instead of asking the server */
+			if (!c->fullscreen) {
+				if (mask & CWX)
+					c->x = config_ev->x;
+				if (mask & CWY)
+					c->y = config_ev->y;
+				if (mask & CWWidth)
+					c->w = config_ev->width;
+				if (mask & CWHeight)
+					c->h = config_ev->height;
+			}
+			/* stacking belongs to restack, a raise request goes through it */
+			if ((mask & CWStackMode) && config_ev->detail == Above)
+				raise_client(c);
+			mask &= ~(CWSibling | CWStackMode);
+		}
+
 		/* allow client to configure itself */
 		XWindowChanges wc = {
 			.x = config_ev->x,
@@ -1026,11 +1465,17 @@ void hdl_config_req(XEvent *xev)
 			.sibling = config_ev->above,
 			.stack_mode = config_ev->detail
 		};
-		XConfigureWindow(dpy, config_ev->window, config_ev->value_mask, &wc);
+		XConfigureWindow(dpy, config_ev->window, mask, &wc);
 		return;
 	}
 }
 
+void hdl_crossing(XEvent *xev)
+{
+	ptr_x = xev->xcrossing.x_root;
+	ptr_y = xev->xcrossing.y_root;
+}
+
 void hdl_dummy(XEvent *xev)
 {
 	(void)xev;
@@ -1077,8 +1522,10 @@ void hdl_destroy_ntf(XEvent *xev)
 			if (ws_focused[ws] == c)
 				ws_focused[ws] = NULL;
 
-		if (focused == c)
+		if (focused == c) {
 			focused = NULL;
+			ipc_notify(IPC_EV_FOCUS);
+		}
 
 		/* unlink from workspace list */
 		if (!prev)
@@ -1086,10 +1533,17 @@ void hdl_destroy_ntf(XEvent *xev)
 		else
 			prev->next = c->next;
 
+		swallow_index_remove(c);
+		client_list_remove(c);
 		free(c);
 		update_net_client_list();
+		stats.clients_removed++;
+		ipc_notify(IPC_EV_CLIENT_REMOVE);
 		open_windows--;
 
+		if (i != current_ws)
+			ws_dirty[i] = True;
+
 		if (i == current_ws) {
 			tile();
 			update_borders();
@@ -1115,6 +1569,11 @@ void hdl_destroy_ntf(XEvent *xev)
 
 		return;
 	}
+
+	if (is_dock(w)) {
+		struts_stale = True;
+		tile();
+	}
 }
 
 void hdl_keypress(XEvent *xev)
@@ -1125,15 +1584,7 @@ void hdl_keypress(XEvent *xev)
 	for (int i = 0; i < user_config.n_binds; i++) {
 		Binding *bind = &user_config.binds[i];
 		if (bind->keycode == code && clean_mask(bind->mods) == mods) {
-			switch (bind->type) {
-				case TYPE_CMD: spawn(bind->action.cmd); break;
-				case TYPE_FUNC: if (bind->action.fn) bind->action.fn(); break;
-				case TYPE_WS_CHANGE: change_workspace(bind->action.ws); update_net_client_list(); break;
-				case TYPE_WS_MOVE: move_to_workspace(bind->action.ws); update_net_client_list(); break;
-				case TYPE_SP_REMOVE: remove_scratchpad(bind->action.sp); break;
-				case TYPE_SP_TOGGLE: toggle_scratchpad(bind->action.sp); break;
-				case TYPE_SP_CREATE: set_win_scratchpad(bind->action.sp); break;
-			}
+			run_binding(bind);
 			return;
 		}
 	}
@@ -1150,124 +1601,909 @@ void hdl_map_req(XEvent *xev)
 {
 	Window w = xev->xmaprequest.window;
 	XWindowAttributes win_attr;
+	PROBE1(map_request, w);
 
-	if (!XGetWindowAttributes(dpy, w, &win_attr))
-		return;
+	if (XGetWindowAttributes(dpy, w, &win_attr))
+		manage_window(w, &win_attr);
+}
 
-	/* skips invisible windows */
-	if (win_attr.override_redirect || win_attr.width <= 0 || win_attr.height <= 0) {
-		XMapWindow(dpy, w);
-		return;
-	}
+void hdl_motion(XEvent *xev)
+{
+	XMotionEvent *motion_ev = &xev->xmotion;
 
-	/* check if this window is already managed on any workspace */
-	Client *c = find_client(w);
-	if (c) {
-		if (c->ws == current_ws) {
-			if (!c->mapped) {
-				XMapWindow(dpy, w);
-				c->mapped = True;
-			}
-			if (user_config.new_win_focus) {
-				focused = c;
-				set_input_focus(c, True, True);
-				return; /* set_input_focus already calls update_borders */
-			}
-			update_borders();
-		}
+	ptr_x = motion_ev->x_root;
+	ptr_y = motion_ev->y_root;
+	if ((drag_mode == DRAG_NONE || !drag_client) ||
+		(motion_ev->time - last_motion_time <= (1000 / (Time)user_config.motion_throttle)))
 		return;
-	}
+	last_motion_time = motion_ev->time;
 
+	/* figure out which monitor the pointer is in right now */
+	int mon = 0;
+	for (int i = 0; i < n_mons; i++) {
+		Bool is_current_mon =
+			motion_ev->x_root >= mons[i].x &&
+			motion_ev->x_root < mons[i].x + mons[i].w &&
+			motion_ev->y_root >= mons[i].y &&
+			motion_ev->y_root < mons[i].y + mons[i].h;
 
-	Atom type;
-	int format;
-	unsigned long n_items, after;
-	Atom *types = NULL;
-	Bool should_float = False;
+		if (is_current_mon) {
+			mon = i;
+			break;
+		}
+	}
+	Monitor *current_mon_motion = &mons[mon];
 
-	if (XGetWindowProperty(dpy, w, atoms[ATOM_NET_WM_WINDOW_TYPE], 0, 4, False, XA_ATOM, &type, &format,
-	    &n_items, &after, (unsigned char **)&types) == Success && types) {
+	if (drag_mode == DRAG_SWAP) {
+		Window root_ret, child;
+		int rx, ry, wx, wy;
+		unsigned int mask;
+		XQueryPointer(dpy, root, &root_ret, &child, &rx, &ry, &wx, &wy, &mask);
 
-		for (unsigned long i = 0; i < n_items; i++) {
-			if (types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_DOCK]) {
-				XFree(types);
-				XMapWindow(dpy, w);
-				return;
-			}
+		Client *new_target = NULL;
 
-			if (types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_UTILITY] ||
-				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_DIALOG]  ||
-				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_TOOLBAR] ||
-				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_SPLASH]  ||
-				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_POPUP_MENU] ||
-				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_DROPDOWN_MENU] ||
-				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_MENU] ||
-				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_TOOLTIP] ||
-				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_NOTIFICATION]) {
-				should_float = True;
+		for (Client *c = workspaces[current_ws]; c; c = c->next) {
+			if (c == drag_client || c->floating)
+				continue;
+			if (c->win == child) {
+				new_target = c;
 				break;
 			}
-		}
-		XFree(types);
-	}
-
-	if (!should_float)
-		should_float = window_should_float(w);
-
-	if (!should_float) {
-		Atom state_type;
-		Atom *state_atoms = NULL;
-		int state_format;
-		unsigned long bytes_after;
-		n_items = 0;
-
-		if (XGetWindowProperty(dpy, w, atoms[ATOM_NET_WM_STATE], 0, 8, False, XA_ATOM, &state_type, &state_format, &n_items,
-					           &bytes_after, (unsigned char**)&state_atoms) == Success && state_atoms) {
-			for (unsigned long i = 0; i < n_items; i++) {
-				if (state_atoms[i] == atoms[ATOM_NET_WM_STATE_MODAL]) {
-					should_float = True;
+			Window root_ret2, parent;
+			Window *children;
+			unsigned int n_children;
+			if (XQueryTree(dpy, child, &root_ret2, &parent, &children, &n_children)) {
+				if (children)
+					XFree(children);
+				if (parent == c->win) {
+					new_target = c;
 					break;
 				}
 			}
-			XFree(state_atoms);
 		}
-	}
 
-	if (open_windows == MAX_CLIENTS) {
-		fprintf(stderr, "sxwm: max clients reached, ignoring map request\n");
-		return;
-	}
+		if (new_target != swap_target) {
+			if (swap_target) {
+				set_border_colour(swap_target, swap_target == focused ?
+				                  user_config.border_foc_col : user_config.border_ufoc_col);
+			}
+			if (new_target)
+				set_border_colour(new_target, user_config.border_swap_col);
+		}
 
-	int target_ws = get_workspace_for_window(w);
-	c = add_client(w, target_ws);
-	if (!c)
+		swap_target = new_target;
 		return;
-	set_wm_state(w, NormalState);
+	}
+	else if (drag_mode == DRAG_MOVE) {
+		int dx = motion_ev->x_root - drag_start_x;
+		int dy = motion_ev->y_root - drag_start_y;
+		int nx = drag_orig_x + dx;
+		int ny = drag_orig_y + dy;
 
-	Window transient;
-	if (!should_float && XGetTransientForHint(dpy, w, &transient))
-		should_float = True;
+		int outer_w = drag_client->w + 2 * user_config.border_width;
+		int outer_h = drag_client->h + 2 * user_config.border_width;
 
-	XSizeHints size_hints;
-	long supplied_ret;
+		/* snap relative to this mons bounds: */
+		int rel_x = nx - current_mon_motion->x;
+		int rel_y = ny - current_mon_motion->y;
 
-	if (!should_float &&
-		XGetWMNormalHints(dpy, w, &size_hints, &supplied_ret) &&
-		(size_hints.flags & PMinSize) && (size_hints.flags & PMaxSize) &&
-		size_hints.min_width  == size_hints.max_width &&
-		size_hints.min_height == size_hints.max_height) {
+		rel_x = snap_coordinate(rel_x, outer_w, current_mon_motion->w, user_config.snap_distance);
+		rel_y = snap_coordinate(rel_y, outer_h, current_mon_motion->h, user_config.snap_distance);
 
-		should_float = True;
-		c->fixed = True;
-	}
+		nx = current_mon_motion->x + rel_x;
+		ny = current_mon_motion->y + rel_y;
 
-	if (should_float || global_floating)
-		c->floating = True;
+		if (!drag_client->floating && (UDIST(nx, drag_client->x) > user_config.snap_distance ||
+			UDIST(ny, drag_client->y) > user_config.snap_distance)) {
+			toggle_floating();
+		}
 
-	if (window_should_start_fullscreen(w)) {
-		c->fullscreen = True;
-		c->floating = False;
-	}
+		XMoveWindow(dpy, drag_client->win, nx, ny);
+		drag_client->x = nx;
+		drag_client->y = ny;
+	}
+	else if (drag_mode == DRAG_RESIZE) {
+		int dx = motion_ev->x_root - drag_start_x;
+		int dy = motion_ev->y_root - drag_start_y;
+		int nw = drag_orig_w + dx;
+		int nh = drag_orig_h + dy;
+
+		/* clamp relative to this mon */
+		int max_w = (current_mon_motion->w - (drag_client->x - current_mon_motion->x));
+		int max_h = (current_mon_motion->h - (drag_client->y - current_mon_motion->y));
+
+		drag_client->w = CLAMP(nw, MIN_WINDOW_SIZE, max_w);
+		drag_client->h = CLAMP(nh, MIN_WINDOW_SIZE, max_h);
+
+		XResizeWindow(dpy, drag_client->win, drag_client->w, drag_client->h);
+	}
+}
+
+void hdl_property_ntf(XEvent *xev)
+{
+	XPropertyEvent *property_ev = &xev->xproperty;
+
+	if (property_ev->window == root) {
+		/* our own switches come back here, the value is already current */
+		if (property_ev->atom == atoms[ATOM_NET_CURRENT_DESKTOP] && desktop_echoes > 0) {
+			desktop_echoes--;
+		}
+		else if (property_ev->atom == atoms[ATOM_NET_CURRENT_DESKTOP]) {
+			long *val = NULL;
+			Atom actual;
+			int fmt;
+			unsigned long n;
+			unsigned long after;
+			if (XGetWindowProperty(dpy, root, atoms[ATOM_NET_CURRENT_DESKTOP], 0, 1, False, XA_CARDINAL, &actual,
+						           &fmt, &n, &after, (unsigned char **)&val) == Success && val) {
+				change_workspace((int)val[0]);
+				XFree(val);
+			}
+		}
+	}
+
+	/* docks get PropertyChangeMask from update_struts */
+	if (property_ev->atom == atoms[ATOM_NET_WM_STRUT_PARTIAL]) {
+		struts_stale = True;
+		tile();
+		update_borders();
+		return;
+	}
+
+	/* client window properties */
+	if (property_ev->atom == atoms[ATOM_NET_WM_STATE]) {
+		Client *c = find_client(find_toplevel(property_ev->window));
+		if (!c)
+			return;
+
+		/* notifications for our own writes carry nothing new */
+		if (c->state_echoes > 0) {
+			c->state_echoes--;
+			return;
+		}
+		client_load_state(c);
+		Bool want = client_has_state(c, atoms[ATOM_NET_WM_STATE_FULLSCREEN]);
+		if (want != c->fullscreen)
+			apply_fullscreen(c, want);
+	}
+
+	if (property_ev->atom == atoms[ATOM_WM_PROTOCOLS]) {
+		Client *c = find_client(property_ev->window);
+		if (c && c->protocols_echo)
+			c->protocols_echo = False;
+		else if (c)
+			c->take_focus = -1;
+	}
+}
+
+void hdl_unmap_ntf(XEvent *xev)
+{
+	if (is_dock(xev->xunmap.window))
+		struts_stale = True;
+
+	if (!in_ws_switch) {
+		Window w = xev->xunmap.window;
+		for (Client *c = workspaces[current_ws]; c; c = c->next) {
+			if (c->win == w) {
+				c->mapped = False;
+				break;
+			}
+		}
+	}
+
+	update_net_client_list();
+	tile();
+	update_borders();
+}
+
+void hide_client(Client *c)
+{
+	if (user_config.hide_offscreen) {
+		/* keep it mapped so the client holds on to its surfaces */
+		XMoveWindow(dpy, c->win, -(c->w + 2 * user_config.border_width), c->y);
+		XMapWindow(dpy, c->win);
+		c->offscreen = True;
+	}
+	else {
+		XUnmapWindow(dpy, c->win);
+	}
+
+	set_wm_state(c->win, IconicState);
+	client_set_state(c, atoms[ATOM_NET_WM_STATE_HIDDEN], True);
+}
+
+unsigned long hist_percentile(int type, double q)
+{
+	unsigned long count = 0;
+	for (int b = 0; b < HIST_BUCKETS; b++)
+		count += stats.hist[type][b];
+
+	/* upper bound of the bucket holding the q-th sample, in microseconds */
+	unsigned long seen = 0;
+	for (int b = 0; b < HIST_BUCKETS - 1; b++) {
+		seen += stats.hist[type][b];
+		if (seen >= q * count)
+			return 1UL << b;
+	}
+	return 1UL << (HIST_BUCKETS - 2);
+}
+
+void inc_gaps(void)
+{
+	user_config.gaps++;
+	tile();
+	update_borders();
+}
+
+void init_defaults(void)
+{
+	user_config.modkey = Mod4Mask;
+	user_config.gaps = 10;
+	user_config.border_width = 1;
+	user_config.border_foc_col = parse_col("#c0cbff");
+	user_config.border_ufoc_col = parse_col("#555555");
+	user_config.border_swap_col = parse_col("#fff4c0");
+	user_config.move_window_amt = 10;
+	user_config.resize_window_amt = 10;
+
+	for (int i = 0; i < MAX_MONITORS; i++)
+		user_config.master_width[i] = 50 / 100.0f;
+
+	for (int i = 0; i < MAX_ITEMS; i++) {
+		user_config.can_be_swallowed[i] = NULL;
+		user_config.can_swallow[i] = NULL;
+		user_config.open_in_workspace[i] = NULL;
+		user_config.start_fullscreen[i] = NULL;
+	}
+
+	user_config.motion_throttle = 60;
+	user_config.resize_master_amt = 5;
+	user_config.resize_stack_amt = 20;
+	user_config.snap_distance = 5;
+	user_config.stall_budget = 0;
+	user_config.n_binds = 0;
+	user_config.new_win_focus = True;
+	user_config.warp_cursor = True;
+	user_config.new_win_master = False;
+	user_config.floating_on_top = True;
+	user_config.hide_offscreen = False;
+	user_config.handler_timing = False;
+}
+
+void ipc_accept(void)
+{
+	int fd = accept(ipc_fd, NULL, NULL);
+	if (fd < 0)
+		return;
+
+	for (int i = 0; i < IPC_MAX_CONNS; i++) {
+		IpcConn *ic = &ipc_conns[i];
+		if (ic->fd < 0) {
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+			fcntl(fd, F_SETFL, O_NONBLOCK);
+			ic->fd = fd;
+			ic->subs = 0;
+			ic->in_len = 0;
+			ic->out_len = 0;
+			return;
+		}
+	}
+	/* every slot is taken */
+	close(fd);
+}
+
+void ipc_batch(char *steps)
+{
+	Binding batch[IPC_MAX_BATCH];
+	int n = 0;
+	char *save = NULL;
+
+	/* parse everything first so a typo does not leave a half applied batch */
+	for (char *st = steps ? strtok_r(steps, ";", &save) : NULL; st; st = strtok_r(NULL, ";", &save)) {
+		if (n >= IPC_MAX_BATCH) {
+			ipc_printf("error batch longer than %d steps\n", IPC_MAX_BATCH);
+			return;
+		}
+		while (*st == ' ')
+			st++;
+		if (parse_action(st, &batch[n]) < 0) {
+			ipc_printf("error unknown action '%s'\n", st);
+			return;
+		}
+		n++;
+	}
+
+	batch_begin();
+	for (int i = 0; i < n && running; i++)
+		run_binding(&batch[i]);
+	batch_commit();
+
+	ipc_printf("ok %d\n", n);
+}
+
+void ipc_cleanup(void)
+{
+	for (int i = 0; i < IPC_MAX_CONNS; i++)
+		if (ipc_conns[i].fd >= 0)
+			ipc_close(&ipc_conns[i]);
+
+	if (ipc_fd >= 0) {
+		close(ipc_fd);
+		unlink(ipc_path);
+		ipc_fd = -1;
+	}
+}
+
+int ipc_client(int ac, char **av)
+{
+	char path[PATH_MAX];
+	char req[IPC_IN_SIZE];
+	uint32_t len = 0;
+	const char *env = getenv("SXWM_SOCKET");
+
+	if (env && *env)
+		snprintf(path, sizeof(path), "%s", env);
+	else
+		runtime_path(path, sizeof(path), "sock");
+
+	for (int i = 0; i < ac; i++) {
+		int n = snprintf(req + len, sizeof(req) - sizeof(len) - len, "%s%s", i ? " " : "", av[i]);
+		if (n < 0 || (size_t)n >= sizeof(req) - sizeof(len) - len) {
+			fprintf(stderr, "sxwm: request too long\n");
+			return EXIT_FAILURE;
+		}
+		len += n;
+	}
+
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "sxwm: socket path too long: %s\n", path);
+		return EXIT_FAILURE;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "sxwm: cannot connect to %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	if (write(fd, &len, sizeof(len)) != sizeof(len) || write(fd, req, len) != (ssize_t)len) {
+		fprintf(stderr, "sxwm: cannot send request\n");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	static char reply[IPC_OUT_SIZE];
+	if (!read_full(fd, &len, sizeof(len)) || len > sizeof(reply) || !read_full(fd, reply, len)) {
+		fprintf(stderr, "sxwm: no reply\n");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	fwrite(reply, 1, len, stdout);
+
+	if (strncmp(reply, "error", 5) == 0) {
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	/* subscribers keep printing events until sxwm goes away */
+	if (strcmp(av[0], "subscribe") == 0) {
+		fflush(stdout);
+		while (read_full(fd, &len, sizeof(len)) && len <= sizeof(reply) && read_full(fd, reply, len)) {
+			fwrite(reply, 1, len, stdout);
+			fflush(stdout);
+		}
+	}
+	close(fd);
+	return EXIT_SUCCESS;
+}
+
+void ipc_close(IpcConn *ic)
+{
+	close(ic->fd);
+	ic->fd = -1;
+	ic->subs = 0;
+	ic->in_len = 0;
+	ic->out_len = 0;
+}
+
+void ipc_flush(IpcConn *ic)
+{
+	while (ic->out_len > 0) {
+		ssize_t n = send(ic->fd, ic->out, ic->out_len, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				ipc_close(ic);
+			return;
+		}
+		memmove(ic->out, ic->out + n, ic->out_len - n);
+		ic->out_len -= n;
+	}
+}
+
+void ipc_handle(IpcConn *ic, char *req)
+{
+	char *arg = strchr(req, ' ');
+	if (arg)
+		*arg++ = '\0';
+
+	ipc_msg_len = 0;
+	if (strcmp(req, "batch") == 0)
+		ipc_batch(arg);
+	else if (strcmp(req, "clients") == 0)
+		ipc_query_clients();
+	else if (strcmp(req, "monitors") == 0)
+		ipc_query_monitors();
+	else if (strcmp(req, "ring") == 0) {
+		if (ring_dump())
+			ipc_printf("path %s\n", ring_path);
+		else
+			ipc_printf("error cannot write %s\n", ring_path);
+	}
+	else if (strcmp(req, "roundtrips") == 0)
+		ipc_query_roundtrips();
+	else if (strcmp(req, "scratchpads") == 0)
+		ipc_query_scratchpads();
+	else if (strcmp(req, "state") == 0)
+		ipc_query_state();
+	else if (strcmp(req, "stats") == 0)
+		stats_format();
+	else if (strcmp(req, "subscribe") == 0) {
+		ipc_subscribe(ic, arg);
+		return;
+	}
+	else
+		ipc_printf("error unknown request '%s'\n", req);
+
+	if (!ipc_send(ic, ipc_msg, ipc_msg_len) && ic->fd >= 0)
+		ipc_close(ic);
+}
+
+void ipc_init(void)
+{
+	for (int i = 0; i < IPC_MAX_CONNS; i++)
+		ipc_conns[i].fd = -1;
+
+	runtime_path(ipc_path, sizeof(ipc_path), "sock");
+
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (strlen(ipc_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "sxwm: socket path too long: %s\n", ipc_path);
+		return;
+	}
+	strcpy(addr.sun_path, ipc_path);
+
+	if ((ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("sxwm: socket");
+		return;
+	}
+	fcntl(ipc_fd, F_SETFD, FD_CLOEXEC);
+	fcntl(ipc_fd, F_SETFL, O_NONBLOCK);
+
+	/* other_wm() already made sure no other sxwm owns this display */
+	unlink(ipc_path);
+	mode_t mask = umask(077);
+	int ret = bind(ipc_fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+
+	if (ret < 0 || listen(ipc_fd, IPC_MAX_CONNS) < 0) {
+		fprintf(stderr, "sxwm: cannot listen on %s\n", ipc_path);
+		close(ipc_fd);
+		ipc_fd = -1;
+		return;
+	}
+	setenv("SXWM_SOCKET", ipc_path, 1);
+}
+
+void ipc_notify(unsigned int events)
+{
+	/* coalesced, ipc_publish sends them once per main loop iteration */
+	ipc_pending |= events;
+}
+
+void ipc_poll(void)
+{
+	struct pollfd pfds[IPC_MAX_CONNS + 2];
+	IpcConn *owner[IPC_MAX_CONNS + 2] = {NULL};
+	int n = 0;
+
+	pfds[n++] = (struct pollfd){.fd = ConnectionNumber(dpy), .events = POLLIN};
+	if (ipc_fd >= 0)
+		pfds[n++] = (struct pollfd){.fd = ipc_fd, .events = POLLIN};
+
+	for (int i = 0; i < IPC_MAX_CONNS; i++) {
+		IpcConn *ic = &ipc_conns[i];
+		if (ic->fd < 0)
+			continue;
+		owner[n] = ic;
+		pfds[n++] = (struct pollfd){.fd = ic->fd, .events = POLLIN | (ic->out_len ? POLLOUT : 0)};
+	}
+
+	if (poll(pfds, n, -1) <= 0)
+		return;
+
+	/* pfds[0] is the X connection, run() reads it */
+	for (int i = 1; i < n && running; i++) {
+		if (!pfds[i].revents)
+			continue;
+
+		if (!owner[i]) {
+			ipc_accept();
+			continue;
+		}
+		if (pfds[i].revents & POLLOUT)
+			ipc_flush(owner[i]);
+		if (owner[i]->fd >= 0 && pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+			ipc_read(owner[i]);
+	}
+}
+
+void ipc_print_events(unsigned int events)
+{
+	if (events & IPC_EV_FOCUS)
+		ipc_printf("focus 0x%lx\n", focused ? focused->win : None);
+	if (events & IPC_EV_WORKSPACE)
+		ipc_printf("workspace %d\n", current_ws + 1);
+	if (events & IPC_EV_CLIENT_ADD)
+		ipc_printf("client add\n");
+	if (events & IPC_EV_CLIENT_REMOVE)
+		ipc_printf("client remove\n");
+	if (events & IPC_EV_LAYOUT)
+		ipc_printf("layout workspace %d monocle %d floating %d\n", current_ws + 1, monocle, global_floating);
+	if (events & IPC_EV_MONITOR)
+		ipc_printf("monitor count %d focused %d\n", n_mons, current_mon);
+}
+
+void ipc_printf(const char *fmt, ...)
+{
+	size_t room = sizeof(ipc_msg) - ipc_msg_len;
+	va_list ap;
+
+	va_start(ap, fmt);
+	int n = vsnprintf(ipc_msg + ipc_msg_len, room, fmt, ap);
+	va_end(ap);
+
+	if (n > 0)
+		ipc_msg_len += MIN((size_t)n, room - 1);
+}
+
+void ipc_publish(void)
+{
+	unsigned int events = ipc_pending;
+	ipc_pending = 0;
+	if (!events)
+		return;
+
+	for (int i = 0; i < IPC_MAX_CONNS; i++) {
+		IpcConn *ic = &ipc_conns[i];
+		if (ic->fd < 0 || !(ic->subs & events))
+			continue;
+
+		ipc_msg_len = 0;
+		ipc_print_events(ic->subs & events);
+		/* a subscriber that let its queue fill up is dropped, never waited on */
+		if (!ipc_send(ic, ipc_msg, ipc_msg_len) && ic->fd >= 0)
+			ipc_close(ic);
+	}
+}
+
+void ipc_query_clients(void)
+{
+	for (int ws = 0; ws < NUM_WORKSPACES; ws++) {
+		for (Client *c = workspaces[ws]; c; c = c->next) {
+			int sp = 0;
+			for (int i = 0; i < MAX_SCRATCHPADS; i++) {
+				if (scratchpads[i].client == c) {
+					sp = i + 1;
+					break;
+				}
+			}
+
+			ipc_printf("0x%lx ws %d mon %d x %d y %d w %d h %d floating %d fullscreen %d "
+			           "mapped %d focused %d scratchpad %d pid %d\n",
+			           c->win, ws + 1, c->mon, c->x, c->y, c->w, c->h, c->floating, c->fullscreen,
+			           c->mapped, c == focused, sp, (int)c->pid);
+		}
+	}
+}
+
+void ipc_query_monitors(void)
+{
+	for (int i = 0; i < n_mons; i++) {
+		Monitor *m = &mons[i];
+		ipc_printf("%d x %d y %d w %d h %d reserve %d %d %d %d master %.2f focused %d\n", i, m->x, m->y,
+		           m->w, m->h, m->reserve_left, m->reserve_right, m->reserve_top, m->reserve_bottom,
+		           user_config.master_width[i], i == current_mon);
+	}
+}
+
+void ipc_query_roundtrips(void)
+{
+	for (int i = 0; i < LASTEvent; i++) {
+		unsigned long handled = i ? stats.events[i] : 0;
+		if (!stats.rt_calls[i])
+			continue;
+
+		ipc_printf("event %s handled %lu round_trips %lu", i ? event_names[i] : "none", handled, stats.rt_calls[i]);
+		if (handled)
+			ipc_printf(" avg %.1f max %lu ms_avg %.3f", (double)stats.rt_calls[i] / handled, stats.rt_max[i],
+			           stats.rt_ns[i] / 1e6 / handled);
+		ipc_printf(" ms %.3f\n", stats.rt_ns[i] / 1e6);
+	}
+
+	/* call sites, most expensive first */
+	int order[RT_MAX_SITES];
+	for (int i = 0; i < rt_n_sites; i++) {
+		int j = i;
+		for (; j > 0 && rt_sites[order[j - 1]].ns < rt_sites[i].ns; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+	for (int i = 0; i < rt_n_sites; i++) {
+		RoundTripSite *rs = &rt_sites[order[i]];
+		ipc_printf("site %s:%d calls %lu ms %.3f us_avg %.1f\n", rs->func, rs->line, rs->calls, rs->ns / 1e6,
+		           rs->ns / 1e3 / rs->calls);
+	}
+}
+
+void ipc_query_scratchpads(void)
+{
+	for (int i = 0; i < MAX_SCRATCHPADS; i++)
+		if (scratchpads[i].client)
+			ipc_printf("%d 0x%lx enabled %d\n", i + 1, scratchpads[i].client->win, scratchpads[i].enabled);
+}
+
+void ipc_query_state(void)
+{
+	int n_clients = 0;
+	for (Client *c = workspaces[current_ws]; c; c = c->next)
+		n_clients++;
+
+	ipc_printf("workspace %d\nprevious %d\nmonitor %d\nfocused 0x%lx\nclients %d\nmonocle %d\nfloating %d\n",
+	           current_ws + 1, previous_workspace + 1, current_mon, focused ? focused->win : None, n_clients,
+	           monocle, global_floating);
+}
+
+void ipc_read(IpcConn *ic)
+{
+	ssize_t n = recv(ic->fd, ic->in + ic->in_len, sizeof(ic->in) - ic->in_len, 0);
+	if (n <= 0) {
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			return;
+		ipc_close(ic);
+		return;
+	}
+	ic->in_len += n;
+
+	/* requests are a native-endian 32 bit length followed by that many bytes of text */
+	while (running && ic->fd >= 0 && ic->in_len >= sizeof(uint32_t)) {
+		char req[IPC_IN_SIZE];
+		uint32_t len;
+
+		memcpy(&len, ic->in, sizeof(len));
+		if (len >= sizeof(ic->in) - sizeof(len)) {
+			ipc_close(ic);
+			return;
+		}
+		if (ic->in_len < sizeof(len) + len)
+			break;
+
+		memcpy(req, ic->in + sizeof(len), len);
+		req[len] = '\0';
+		ic->in_len -= sizeof(len) + len;
+		memmove(ic->in, ic->in + sizeof(len) + len, ic->in_len);
+		ipc_handle(ic, req);
+	}
+}
+
+Bool ipc_send(IpcConn *ic, const char *msg, size_t len)
+{
+	uint32_t hdr = len;
+
+	if (ic->out_len + sizeof(hdr) + len > sizeof(ic->out))
+		return False;
+
+	memcpy(ic->out + ic->out_len, &hdr, sizeof(hdr));
+	memcpy(ic->out + ic->out_len + sizeof(hdr), msg, len);
+	ic->out_len += sizeof(hdr) + len;
+	ipc_flush(ic);
+	return True;
+}
+
+void ipc_subscribe(IpcConn *ic, char *topics)
+{
+	static const struct {
+		const char *name;
+		unsigned int events;
+	} names[] = {
+		{"focus", IPC_EV_FOCUS},
+		{"workspace", IPC_EV_WORKSPACE},
+		{"client", IPC_EV_CLIENT_ADD | IPC_EV_CLIENT_REMOVE},
+		{"layout", IPC_EV_LAYOUT},
+		{"monitor", IPC_EV_MONITOR},
+	};
+	unsigned int subs = 0;
+	char *save = NULL;
+
+	for (char *t = topics ? strtok_r(topics, " ", &save) : NULL; t; t = strtok_r(NULL, " ", &save)) {
+		unsigned int ev = 0;
+		for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+			if (strcmp(t, names[i].name) == 0)
+				ev = names[i].events;
+
+		if (!ev) {
+			ipc_printf("error unknown topic '%s'\n", t);
+			break;
+		}
+		subs |= ev;
+	}
+	if (!subs && !ipc_msg_len)
+		ipc_printf("error no topics\n");
+
+	if (ipc_msg_len) {
+		if (!ipc_send(ic, ipc_msg, ipc_msg_len) && ic->fd >= 0)
+			ipc_close(ic);
+		return;
+	}
+
+	/* acknowledge with the current state of every stateful topic */
+	ic->subs = subs;
+	ipc_printf("ok\n");
+	ipc_print_events(subs & ~(IPC_EV_CLIENT_ADD | IPC_EV_CLIENT_REMOVE));
+	if (!ipc_send(ic, ipc_msg, ipc_msg_len) && ic->fd >= 0)
+		ipc_close(ic);
+}
+
+Bool is_child_proc(pid_t parent_pid, pid_t child_pid)
+{
+	return parent_pid != child_pid && check_parent(parent_pid, child_pid) != 0;
+}
+
+Bool is_dock(Window w)
+{
+	for (int i = 0; i < n_docks; i++)
+		if (docks[i] == w)
+			return True;
+	return False;
+}
+
+uint64_t layout_hash(void)
+{
+	/* everything tile_ws reads that is not per workspace */
+	uint64_t h = 1469598103934665603ULL;
+	int in[] = {n_mons, user_config.gaps, user_config.border_width, monocle};
+
+	for (size_t i = 0; i < sizeof(in) / sizeof(in[0]); i++)
+		h = (h ^ (uint64_t)in[i]) * 1099511628211ULL;
+	for (int m = 0; m < n_mons; m++) {
+		int mon[] = {mons[m].x, mons[m].y, mons[m].w, mons[m].h, mons[m].reserve_left,
+		             mons[m].reserve_right, mons[m].reserve_top, mons[m].reserve_bottom,
+		             (int)(user_config.master_width[m] * 10000)};
+		for (size_t i = 0; i < sizeof(mon) / sizeof(mon[0]); i++)
+			h = (h ^ (uint64_t)mon[i]) * 1099511628211ULL;
+	}
+	return h;
+}
+
+void manage_window(Window w, XWindowAttributes *wa)
+{
+	/* skips invisible windows */
+	if (wa->override_redirect || wa->width <= 0 || wa->height <= 0) {
+		XMapWindow(dpy, w);
+		return;
+	}
+
+	/* check if this window is already managed on any workspace */
+	Client *c = find_client(w);
+	if (c) {
+		if (c->ws == current_ws) {
+			if (!c->mapped) {
+				XMapWindow(dpy, w);
+				c->mapped = True;
+			}
+			if (user_config.new_win_focus && !batching) {
+				focused = c;
+				set_input_focus(c, True, True);
+				return; /* set_input_focus already calls update_borders */
+			}
+			update_borders();
+		}
+		return;
+	}
+
+
+	Atom type;
+	int format;
+	unsigned long n_items, after;
+	Atom *types = NULL;
+	Bool should_float = False;
+
+	if (XGetWindowProperty(dpy, w, atoms[ATOM_NET_WM_WINDOW_TYPE], 0, 4, False, XA_ATOM, &type, &format,
+	    &n_items, &after, (unsigned char **)&types) == Success && types) {
+
+		for (unsigned long i = 0; i < n_items; i++) {
+			if (types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_DOCK]) {
+				XFree(types);
+				XMapWindow(dpy, w);
+				struts_stale = True;
+				tile();
+				return;
+			}
+
+			if (types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_UTILITY] ||
+				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_DIALOG]  ||
+				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_TOOLBAR] ||
+				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_SPLASH]  ||
+				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_POPUP_MENU] ||
+				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_DROPDOWN_MENU] ||
+				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_MENU] ||
+				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_TOOLTIP] ||
+				types[i] == atoms[ATOM_NET_WM_WINDOW_TYPE_NOTIFICATION]) {
+				should_float = True;
+				break;
+			}
+		}
+		XFree(types);
+	}
+
+	if (open_windows == MAX_CLIENTS) {
+		fprintf(stderr, "sxwm: max clients reached, ignoring map request\n");
+		return;
+	}
+
+	/* read once, every class rule below matches against it */
+	XClassHint ch = {0};
+	XGetClassHint(dpy, w, &ch);
+	if (!should_float)
+		should_float = window_should_float(&ch);
+
+	int target_ws = get_workspace_for_window(&ch);
+	c = add_client(w, target_ws, wa);
+	if (!c) {
+		XFree(ch.res_class);
+		XFree(ch.res_name);
+		return;
+	}
+	set_wm_state(w, NormalState);
+
+	if (c->pid > 0 && match_class(&ch, user_config.can_swallow))
+		swallow_index_add(c);
+	Bool can_be_swallowed = match_class(&ch, user_config.can_be_swallowed);
+	Bool start_fullscreen = window_should_start_fullscreen(&ch);
+	XFree(ch.res_class);
+	XFree(ch.res_name);
+
+	/* fills the _NET_WM_STATE cache as well, so this is its only read */
+	if (!should_float && client_has_state(c, atoms[ATOM_NET_WM_STATE_MODAL]))
+		should_float = True;
+
+	Window transient;
+	if (!should_float && XGetTransientForHint(dpy, w, &transient))
+		should_float = True;
+
+	XSizeHints size_hints;
+	long supplied_ret;
+
+	if (!should_float &&
+		XGetWMNormalHints(dpy, w, &size_hints, &supplied_ret) &&
+		(size_hints.flags & PMinSize) && (size_hints.flags & PMaxSize) &&
+		size_hints.min_width  == size_hints.max_width &&
+		size_hints.min_height == size_hints.max_height) {
+
+		should_float = True;
+		c->fixed = True;
+	}
+
+	if (should_float || global_floating)
+		c->floating = True;
+
+	if (start_fullscreen) {
+		c->fullscreen = True;
+		c->floating = False;
+	}
 
 	/* center floating windows & set border */
 	if (c->floating && !c->fullscreen) {
@@ -1284,74 +2520,30 @@ void hdl_map_req(XEvent *xev)
 	}
 
 	update_net_client_list();
-	if (target_ws != current_ws)
+	if (target_ws != current_ws) {
+		hide_client(c);
+		ws_dirty[target_ws] = True;
 		return;
+	}
+
+	/* a new focus is known before the layout, so tile paints its border once */
+	if (user_config.new_win_focus && !batching)
+		focused = c;
 
 	/* map & borders */
 	if (!global_floating && !c->floating)
 		tile();
 	else if (c->floating)
-		XRaiseWindow(dpy, w);
+		raise_client(c);
 
 	/* check for swallowing opportunities */
-	{
-		XClassHint ch = {0};
-		Bool can_be_swallowed = False;
-
-		if (XGetClassHint(dpy, w, &ch)) {
-			/* check if new window can be swallowed */
-			for (int i = 0; i < MAX_ITEMS; i++) {
-				if (!user_config.can_be_swallowed[i] || !user_config.can_be_swallowed[i][0])
-					break;
-
-				if ((ch.res_class && strcasecmp(ch.res_class, user_config.can_be_swallowed[i][0]) == 0) ||
-				    (ch.res_name && strcasecmp(ch.res_name, user_config.can_be_swallowed[i][0]) == 0)) {
-					can_be_swallowed = True;
-					break;
-				}
-			}
-
-			/* if window can be swallowed look for a potential swallower */
-			if (can_be_swallowed) {
-				for (Client *p = workspaces[current_ws]; p; p = p->next) {
-					if (p == c || p->swallowed || !p->mapped)
-						continue;
-
-					XClassHint pch = {0};
-					Bool can_swallow = False;
-
-					if (XGetClassHint(dpy, p->win, &pch)) {
-						/* check if this existing window can swallow others */
-						for (int i = 0; i < MAX_ITEMS; i++) {
-							if (!user_config.can_swallow[i] || !user_config.can_swallow[i][0])
-								break;
-
-							if ((pch.res_class && strcasecmp(pch.res_class, user_config.can_swallow[i][0]) == 0) ||
-							    (pch.res_name && strcasecmp(pch.res_name, user_config.can_swallow[i][0]) == 0)) {
-								can_swallow = True;
-								break;
-							}
-						}
-
-						/* check process relationship */
-						if (can_swallow && check_parent(p->pid, c->pid)) {
-							/* we know class matches and the swallower is the parent -> swallow now */
-							swallow_window(p, c);
-							XFree(pch.res_class);
-							XFree(pch.res_name);
-							break;
-						}
-						XFree(pch.res_class);
-						XFree(pch.res_name);
-					}
-				}
-			}
-			XFree(ch.res_class);
-			XFree(ch.res_name);
-		}
+	if (can_be_swallowed) {
+		Client *p = find_swallower(c);
+		if (p)
+			swallow_window(p, c);
 	}
 
-	if (window_has_ewmh_state(w, atoms[ATOM_NET_WM_STATE_FULLSCREEN])) {
+	if (client_has_state(c, atoms[ATOM_NET_WM_STATE_FULLSCREEN])) {
 		c->fullscreen = True;
 		c->floating = False;
 	}
@@ -1362,253 +2554,23 @@ void hdl_map_req(XEvent *xev)
 		apply_fullscreen(c, True);
 	set_frame_extents(w);
 
-	if (user_config.new_win_focus) {
-		focused = c;
+	/* a batched adoption focuses once at the end */
+	if (user_config.new_win_focus && !batching) {
 		set_input_focus(focused, True, True);
 		return;
 	}
 	update_borders();
 }
 
-void hdl_motion(XEvent *xev)
-{
-	XMotionEvent *motion_ev = &xev->xmotion;
-
-	if ((drag_mode == DRAG_NONE || !drag_client) ||
-		(motion_ev->time - last_motion_time <= (1000 / (Time)user_config.motion_throttle)))
-		return;
-	last_motion_time = motion_ev->time;
-
-	/* figure out which monitor the pointer is in right now */
-	int mon = 0;
-	for (int i = 0; i < n_mons; i++) {
-		Bool is_current_mon =
-			motion_ev->x_root >= mons[i].x &&
-			motion_ev->x_root < mons[i].x + mons[i].w &&
-			motion_ev->y_root >= mons[i].y &&
-			motion_ev->y_root < mons[i].y + mons[i].h;
-
-		if (is_current_mon) {
-			mon = i;
-			break;
-		}
-	}
-	Monitor *current_mon_motion = &mons[mon];
-
-	if (drag_mode == DRAG_SWAP) {
-		Window root_ret, child;
-		int rx, ry, wx, wy;
-		unsigned int mask;
-		XQueryPointer(dpy, root, &root_ret, &child, &rx, &ry, &wx, &wy, &mask);
-
-		Client *new_target = NULL;
-
-		for (Client *c = workspaces[current_ws]; c; c = c->next) {
-			if (c == drag_client || c->floating)
-				continue;
-			if (c->win == child) {
-				new_target = c;
-				break;
-			}
-			Window root_ret2, parent;
-			Window *children;
-			unsigned int n_children;
-			if (XQueryTree(dpy, child, &root_ret2, &parent, &children, &n_children)) {
-				if (children)
-					XFree(children);
-				if (parent == c->win) {
-					new_target = c;
-					break;
-				}
-			}
-		}
-
-		if (new_target != swap_target) {
-			if (swap_target) {
-				XSetWindowBorder(
-						dpy, swap_target->win, (swap_target == focused ?
-						user_config.border_foc_col : user_config.border_ufoc_col)
-				);
-			}
-			if (new_target)
-				XSetWindowBorder(dpy, new_target->win, user_config.border_swap_col);
-		}
-
-		swap_target = new_target;
-		return;
-	}
-	else if (drag_mode == DRAG_MOVE) {
-		int dx = motion_ev->x_root - drag_start_x;
-		int dy = motion_ev->y_root - drag_start_y;
-		int nx = drag_orig_x + dx;
-		int ny = drag_orig_y + dy;
-
-		int outer_w = drag_client->w + 2 * user_config.border_width;
-		int outer_h = drag_client->h + 2 * user_config.border_width;
-
-		/* snap relative to this mons bounds: */
-		int rel_x = nx - current_mon_motion->x;
-		int rel_y = ny - current_mon_motion->y;
-
-		rel_x = snap_coordinate(rel_x, outer_w, current_mon_motion->w, user_config.snap_distance);
-		rel_y = snap_coordinate(rel_y, outer_h, current_mon_motion->h, user_config.snap_distance);
-
-		nx = current_mon_motion->x + rel_x;
-		ny = current_mon_motion->y + rel_y;
-
-		if (!drag_client->floating && (UDIST(nx, drag_client->x) > user_config.snap_distance ||
-			UDIST(ny, drag_client->y) > user_config.snap_distance)) {
-			toggle_floating();
-		}
-
-		XMoveWindow(dpy, drag_client->win, nx, ny);
-		drag_client->x = nx;
-		drag_client->y = ny;
-	}
-	else if (drag_mode == DRAG_RESIZE) {
-		int dx = motion_ev->x_root - drag_start_x;
-		int dy = motion_ev->y_root - drag_start_y;
-		int nw = drag_orig_w + dx;
-		int nh = drag_orig_h + dy;
-
-		/* clamp relative to this mon */
-		int max_w = (current_mon_motion->w - (drag_client->x - current_mon_motion->x));
-		int max_h = (current_mon_motion->h - (drag_client->y - current_mon_motion->y));
-
-		drag_client->w = CLAMP(nw, MIN_WINDOW_SIZE, max_w);
-		drag_client->h = CLAMP(nh, MIN_WINDOW_SIZE, max_h);
-
-		XResizeWindow(dpy, drag_client->win, drag_client->w, drag_client->h);
-	}
-}
-
-void hdl_property_ntf(XEvent *xev)
-{
-	XPropertyEvent *property_ev = &xev->xproperty;
-
-	if (property_ev->window == root) {
-		if (property_ev->atom == atoms[ATOM_NET_CURRENT_DESKTOP]) {
-			long *val = NULL;
-			Atom actual;
-			int fmt;
-			unsigned long n;
-			unsigned long after;
-			if (XGetWindowProperty(dpy, root, atoms[ATOM_NET_CURRENT_DESKTOP], 0, 1, False, XA_CARDINAL, &actual,
-						           &fmt, &n, &after, (unsigned char **)&val) == Success && val) {
-				change_workspace((int)val[0]);
-				XFree(val);
-			}
-		}
-		else if (property_ev->atom == atoms[ATOM_NET_WM_STRUT_PARTIAL]) {
-			update_struts();
-			tile();
-			update_borders();
-		}
-	}
-
-	/* client window properties */
-	if (property_ev->atom == atoms[ATOM_NET_WM_STATE]) {
-		Client *c = find_client(find_toplevel(property_ev->window));
-		if (!c)
-			return;
-
-		Bool want = window_has_ewmh_state(c->win, atoms[ATOM_NET_WM_STATE_FULLSCREEN]);
-		if (want != c->fullscreen)
-			apply_fullscreen(c, want);
-	}
-}
-
-void hdl_unmap_ntf(XEvent *xev)
-{
-	if (!in_ws_switch) {
-		Window w = xev->xunmap.window;
-		for (Client *c = workspaces[current_ws]; c; c = c->next) {
-			if (c->win == w) {
-				c->mapped = False;
-				break;
-			}
-		}
-	}
-
-	update_net_client_list();
-	tile();
-	update_borders();
-}
-
-void inc_gaps(void)
-{
-	user_config.gaps++;
-	tile();
-	update_borders();
-}
-
-void init_defaults(void)
+Bool match_class(XClassHint *ch, char **rules[])
 {
-	user_config.modkey = Mod4Mask;
-	user_config.gaps = 10;
-	user_config.border_width = 1;
-	user_config.border_foc_col = parse_col("#c0cbff");
-	user_config.border_ufoc_col = parse_col("#555555");
-	user_config.border_swap_col = parse_col("#fff4c0");
-	user_config.move_window_amt = 10;
-	user_config.resize_window_amt = 10;
-
-	for (int i = 0; i < MAX_MONITORS; i++)
-		user_config.master_width[i] = 50 / 100.0f;
-
 	for (int i = 0; i < MAX_ITEMS; i++) {
-		user_config.can_be_swallowed[i] = NULL;
-		user_config.can_swallow[i] = NULL;
-		user_config.open_in_workspace[i] = NULL;
-		user_config.start_fullscreen[i] = NULL;
-	}
-
-	user_config.motion_throttle = 60;
-	user_config.resize_master_amt = 5;
-	user_config.resize_stack_amt = 20;
-	user_config.snap_distance = 5;
-	user_config.n_binds = 0;
-	user_config.new_win_focus = True;
-	user_config.warp_cursor = True;
-	user_config.new_win_master = False;
-	user_config.floating_on_top = True;
-}
-
-Bool is_child_proc(pid_t parent_pid, pid_t child_pid)
-{
-	if (parent_pid <= 0 || child_pid <= 0)
-		return False;
-
-	char path[PATH_MAX];
-	FILE *f;
-	pid_t current_pid = child_pid;
-	int max_iterations = 20;
-
-	while (current_pid > 1 && max_iterations-- > 0) {
-		snprintf(path, sizeof(path), "/proc/%d/stat", current_pid);
-		f = fopen(path, "r");
-		if (!f) {
-			fprintf(stderr, "sxwm: could not open %s\n", path);
-			return False;
-		}
-
-		int ppid = 0;
-		if (fscanf(f, "%*d %*s %*c %d", &ppid) != 1) {
-			fprintf(stderr, "sxwm: failed to read ppid from %s\n", path);
-			fclose(f);
-			return False;
-		}
-		fclose(f);
+		if (!rules[i] || !rules[i][0])
+			break;
 
-		if (ppid == parent_pid)
+		if ((ch->res_class && strcasecmp(ch->res_class, rules[i][0]) == 0) ||
+		    (ch->res_name && strcasecmp(ch->res_name, rules[i][0]) == 0))
 			return True;
-
-		if (ppid <= 1) {
-			/* Reached init or kernel */
-			fprintf(stderr, "sxwm: reached init/kernel, no relationship found\n");
-			break;
-		}
-		current_pid = ppid;
 	}
 	return False;
 }
@@ -1636,7 +2598,7 @@ void move_master_next(void)
 		warp_cursor(old_focused);
 
 	if (old_focused)
-		send_wm_take_focus(old_focused->win);
+		send_wm_take_focus(old_focused);
 
 	update_borders();
 }
@@ -1665,7 +2627,7 @@ void move_master_prev(void)
 	if (user_config.warp_cursor && old_focused)
 		warp_cursor(old_focused);
 	if (old_focused)
-		send_wm_take_focus(old_focused->win);
+		send_wm_take_focus(old_focused);
 
 	update_borders();
 }
@@ -1764,7 +2726,7 @@ void move_to_workspace(int ws)
 	Client *moved = focused;
 	int from_ws = current_ws;
 
-	XUnmapWindow(dpy, moved->win);
+	hide_client(moved);
 
 	/* remove from current list */
 	Client **pp = &workspaces[from_ws];
@@ -1778,9 +2740,8 @@ void move_to_workspace(int ws)
 	moved->next = workspaces[ws];
 	workspaces[ws] = moved;
 	moved->ws = ws;
-	long desktop = ws;
-	XChangeProperty(dpy, moved->win, atoms[ATOM_NET_WM_DESKTOP], XA_CARDINAL, 32,
-		        PropModeReplace, (unsigned char *)&desktop, 1);
+	set_client_desktop(moved, ws);
+	ws_dirty[ws] = True;
 
 	/* remember it as last-focused for the target workspace */
 	ws_focused[ws] = moved;
@@ -1829,6 +2790,13 @@ void move_win_up(void)
 	XMoveWindow(dpy, focused->win, focused->x, focused->y);
 }
 
+unsigned long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 void other_wm(void)
 {
 	XSetErrorHandler(other_wm_err);
@@ -1863,9 +2831,63 @@ long parse_col(const char *hex)
 		return WhitePixel(dpy, DefaultScreen(dpy));
 	}
 
-	/* possibly unsafe BUT i dont think it can cause any problems.
-	 * used to make sure borders are opaque with compositor like picom */
-	return ((long)col.pixel) | (0xffL << 24);
+	/* possibly unsafe BUT i dont think it can cause any problems.
+	 * used to make sure borders are opaque with compositor like picom */
+	return ((long)col.pixel) | (0xffL << 24);
+}
+
+Bool proc_lookup(pid_t pid, unsigned long long born_before, Bool fresh, ProcEntry *out)
+{
+	ProcEntry *e = &proc_cache[(unsigned)pid % PROC_CACHE_SIZE];
+
+	if (fresh || e->pid != pid || e->start > born_before) {
+		if (read_proc_stat(pid, e) < 0) {
+			e->pid = 0;
+			return False;
+		}
+	}
+
+	/* a parent cannot have started after its child: pid was reused */
+	if (e->start > born_before)
+		return False;
+
+	*out = *e;
+	return True;
+}
+
+int proc_walk(pid_t p, pid_t c, Bool fresh)
+{
+	ProcEntry e;
+
+	if (p <= 0 || c <= 0)
+		return 0;
+	if (p == c)
+		return (int)c;
+
+	/* the new window's process is always read, it is never in the cache for long */
+	if (!proc_lookup(c, (unsigned long long)-1, True, &e))
+		return 0;
+
+	for (int depth = 0; depth < PROC_MAX_DEPTH; depth++) {
+		if (e.ppid == p)
+			return (int)p;
+		if (e.ppid <= 1 || !proc_lookup(e.ppid, e.start, fresh, &e))
+			return 0;
+	}
+	return 0;
+}
+
+void raise_client(Client *c)
+{
+	/* applied by restack once the event or batch is done */
+	restack_needed = True;
+	for (int i = 0; i < stack_n; i++) {
+		if (stack_list[i] == c) {
+			memmove(&stack_list[i], &stack_list[i + 1], (stack_n - i - 1) * sizeof(Client *));
+			stack_list[stack_n - 1] = c;
+			break;
+		}
+	}
 }
 
 void quit(void)
@@ -1880,6 +2902,18 @@ void quit(void)
 	}
 	*/
 
+	/* bring back windows hidden off-screen so the next wm can find them */
+	for (int ws = 0; ws < NUM_WORKSPACES; ws++)
+		for (Client *c = workspaces[ws]; c; c = c->next)
+			if (c->offscreen)
+				XMoveWindow(dpy, c->win, c->x, c->y);
+
+	ipc_cleanup();
+	snapshot_cleanup();
+	if (trace_file) {
+		fclose(trace_file);
+		trace_file = NULL;
+	}
 	XSync(dpy, False);
 	XFreeCursor(dpy, cursor_move);
 	XFreeCursor(dpy, cursor_normal);
@@ -1889,6 +2923,64 @@ void quit(void)
 	running = False;
 }
 
+Bool read_full(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return False;
+		p += n;
+		len -= n;
+	}
+	return True;
+}
+
+int read_proc_stat(pid_t pid, ProcEntry *pe)
+{
+	char path[32];
+	char buf[512];
+
+	if (proc_fd < 0)
+		proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (proc_fd < 0)
+		return -1;
+
+	snprintf(path, sizeof(path), "%d/stat", (int)pid);
+	int fd = openat(proc_fd, path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	ssize_t n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+	buf[n] = '\0';
+
+	/* comm may hold spaces or parens, fields resume after the last ')' */
+	char *p = strrchr(buf, ')');
+	if (!p || !p[1] || !p[2])
+		return -1;
+	p += 3; /* skip ") " and the state field */
+
+	long long v = 0;
+	for (int field = 4; field <= 22; field++) {
+		char *end;
+		v = strtoll(p, &end, 10);
+		if (end == p)
+			return -1;
+		if (field == 4)
+			pe->ppid = (pid_t)v;
+		p = end;
+	}
+
+	pe->pid = pid;
+	pe->start = (unsigned long long)v;
+	return 0;
+}
+
 void reload_config(void)
 {
 	puts("sxwm: reloading config...");
@@ -1896,7 +2988,7 @@ void reload_config(void)
 	/* free binding commands without */
 	for (int i = 0; i < user_config.n_binds; i++) {
 		if (user_config.binds[i].type == TYPE_CMD && user_config.binds[i].action.cmd)
-			free(user_config.binds[i].action.cmd);
+			free_command(user_config.binds[i].action.cmd);
 		user_config.binds[i].action.cmd = NULL;
 		user_config.binds[i].action.fn = NULL;
 		user_config.binds[i].type = -1;
@@ -1944,10 +3036,10 @@ void reload_config(void)
 		}
 	}
 
-	/* free any exec strings */
+	/* free any exec commands */
 	for (int i = 0; i < MAX_ITEMS; i++) {
 		if (user_config.to_run[i]) {
-			free(user_config.to_run[i]);
+			free_command(user_config.to_run[i]);
 			user_config.to_run[i] = NULL;
 		}
 	}
@@ -1983,6 +3075,9 @@ void reload_config(void)
 		}
 	}
 
+	/* can_swallow rules may have changed */
+	swallow_index_rebuild();
+
 	update_client_desktop_properties();
 	update_net_client_list();
 	XSync(dpy, False);
@@ -2109,16 +3204,488 @@ void resize_win_left(void)
 	XResizeWindow(dpy, focused->win, focused->w, focused->h);
 }
 
+void restack(void)
+{
+	Window order[MAX_CLIENTS];
+	int layer[MAX_CLIENTS];
+	int n = 0;
+
+	if (batching) {
+		deferred |= DEFER_RESTACK;
+		return;
+	}
+
+	for (int i = 0; i < stack_n; i++) {
+		Client *c = stack_list[i];
+		layer[i] = STACK_TILED;
+		if (c->floating && user_config.floating_on_top)
+			layer[i] = STACK_FLOATING;
+		if (c->fullscreen)
+			layer[i] = STACK_FULLSCREEN;
+		for (int j = 0; j < MAX_SCRATCHPADS; j++)
+			if (scratchpads[j].client == c)
+				layer[i] = STACK_SCRATCHPAD;
+	}
+	for (int l = 0; l < STACK_LAYERS; l++)
+		for (int i = 0; i < stack_n; i++)
+			if (layer[i] == l)
+				order[n++] = stack_list[i]->win;
+
+	/* windows below the first difference are already in place */
+	int same = 0;
+	while (same < n && same < stack_pub_n && order[same] == stack_pub[same])
+		same++;
+	if (same == n && n == stack_pub_n && !restack_needed)
+		return;
+	restack_needed = False;
+
+	if (n > 0) {
+		/* XRestackWindows wants top to bottom and leaves the first in place */
+		Window top[MAX_CLIENTS];
+		int k = 0;
+		for (int i = n - 1; i >= same; i--)
+			top[k++] = order[i];
+		XRaiseWindow(dpy, order[n - 1]);
+		if (k > 1)
+			XRestackWindows(dpy, top, k);
+	}
+
+	memcpy(stack_pub, order, n * sizeof(Window));
+	if (n != stack_pub_n || same != n)
+		stack_dirty = True;
+	stack_pub_n = n;
+}
+
+void restart(void)
+{
+	char path[PATH_MAX];
+	runtime_path(path, sizeof(path), "restart");
+	if (!restart_save(path)) {
+		fprintf(stderr, "sxwm: cannot write %s, not restarting\n", path);
+		unlink(path);
+		return;
+	}
+
+	/* release the redirect now, the new image must not race our disconnect for it */
+	select_input(root, NoEventMask);
+	XSync(dpy, False);
+	ipc_cleanup();
+	snapshot_cleanup();
+	/* close-on-exec, so the trace only needs flushing and keeps recording if exec fails */
+	if (trace_file)
+		fflush(trace_file);
+
+	/* the timer survives exec, and the new image has no SIGALRM handler until setup */
+	int armed = stall_armed;
+	struct itimerval off = {{0, 0}, {0, 0}};
+	setitimer(ITIMER_REAL, &off, NULL);
+	stall_armed = 0;
+
+	setenv("SXWM_RESTART", path, 1);
+	execvp(restart_argv[0], restart_argv);
+
+	perror("sxwm: restart");
+	if (armed) {
+		stall_arm();
+		stall_armed = armed;
+	}
+	unsetenv("SXWM_RESTART");
+	unlink(path);
+	select_input(root, ROOT_EVENT_MASK);
+	ipc_init();
+	snapshot_init();
+}
+
+Bool restart_restore(const char *path)
+{
+	RestartHeader hdr;
+	struct stat st;
+	/* the /tmp fallback is shared, only trust a file the old process could have written */
+	int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	FILE *f = fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_uid == getuid()
+	          ? fdopen(fd, "rb") : NULL;
+	if (!f || fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, "SXRS", 4) != 0 ||
+	    hdr.version != RESTART_VERSION) {
+		fprintf(stderr, "sxwm: %s is not a restart state\n", path);
+		if (f)
+			fclose(f);
+		else if (fd >= 0)
+			close(fd);
+		unlink(path);
+		return False;
+	}
+	unlink(path);
+
+	current_ws = CLAMP(hdr.current_ws, 0, NUM_WORKSPACES - 1);
+	previous_workspace = CLAMP(hdr.previous_workspace, 0, NUM_WORKSPACES - 1);
+	user_config.gaps = hdr.gaps;
+	monocle = hdr.monocle;
+	global_floating = hdr.global_floating;
+	for (int i = 0; i < MAX_MONITORS; i++)
+		user_config.master_width[i] = hdr.master_width[i];
+
+	long current_desktop = current_ws;
+	XChangeProperty(dpy, root, atoms[ATOM_NET_CURRENT_DESKTOP], XA_CARDINAL, 32,
+	                PropModeReplace, (unsigned char *)&current_desktop, 1);
+	desktop_echoes++;
+
+	/* add_client appends, which keeps the saved stack order */
+	Bool new_win_master = user_config.new_win_master;
+	user_config.new_win_master = False;
+
+	Client *swallowers[MAX_CLIENTS];
+	Window swallowed[MAX_CLIENTS];
+	int n_swallows = 0;
+	Client *stacked[MAX_CLIENTS] = {0};
+	RestartClient rc;
+
+	batch_begin();
+	for (int i = 0; i < hdr.n_clients && fread(&rc, sizeof(rc), 1, f) == 1; i++) {
+		/* the rules already ran in the old process, only check the window still exists */
+		XWindowAttributes wa;
+		if (open_windows == MAX_CLIENTS || !XGetWindowAttributes(dpy, rc.win, &wa))
+			continue;
+
+		Client *c = add_client(rc.win, CLAMP(rc.ws, 0, NUM_WORKSPACES - 1), &wa);
+		if (!c)
+			continue;
+		c->mon = CLAMP(rc.mon, 0, n_mons - 1);
+		c->x = rc.x;
+		c->y = rc.y;
+		c->w = rc.w;
+		c->h = rc.h;
+		c->orig_x = rc.orig_x;
+		c->orig_y = rc.orig_y;
+		c->orig_w = rc.orig_w;
+		c->orig_h = rc.orig_h;
+		c->custom_stack_height = rc.custom_stack_height;
+		c->fixed = rc.fixed;
+		c->floating = rc.floating;
+		c->fullscreen = rc.fullscreen;
+		c->mapped = rc.mapped;
+		c->offscreen = rc.offscreen;
+		if (rc.stack >= 0 && rc.stack < MAX_CLIENTS)
+			stacked[rc.stack] = c;
+		if (rc.can_swallow)
+			swallow_index_add(c);
+		if (rc.swallowed) {
+			swallowers[n_swallows] = c;
+			swallowed[n_swallows++] = rc.swallowed;
+		}
+	}
+	fclose(f);
+	user_config.new_win_master = new_win_master;
+
+	/* add_client stacked them in list order, put back the saved raise order if it is whole;
+	 * nothing is published yet, so the first restack applies all of it */
+	int n = 0;
+	for (int i = 0; i < MAX_CLIENTS; i++)
+		if (stacked[i])
+			stacked[n++] = stacked[i];
+	if (n == stack_n)
+		memcpy(stack_list, stacked, n * sizeof(Client *));
+
+	for (int i = 0; i < n_swallows; i++) {
+		Client *c = find_client(swallowed[i]);
+		if (c && !c->swallower) {
+			swallowers[i]->swallowed = c;
+			c->swallower = swallowers[i];
+		}
+	}
+	for (int i = 0; i < MAX_SCRATCHPADS; i++) {
+		scratchpads[i].client = hdr.scratchpads[i] ? find_client(hdr.scratchpads[i]) : NULL;
+		scratchpads[i].enabled = scratchpads[i].client && hdr.sp_enabled[i];
+	}
+	for (int ws = 0; ws < NUM_WORKSPACES; ws++) {
+		Client *c = hdr.ws_focused[ws] ? find_client(hdr.ws_focused[ws]) : NULL;
+		if (c)
+			ws_focused[ws] = c;
+		if (ws != current_ws && workspaces[ws])
+			ws_dirty[ws] = True;
+	}
+
+	Client *c = hdr.focused ? find_client(hdr.focused) : NULL;
+	if (c && c->ws == current_ws)
+		focused = c;
+	current_mon = CLAMP(focused ? focused->mon : hdr.current_mon, 0, n_mons - 1);
+
+	tile();
+	update_borders();
+	update_net_client_list();
+	update_client_desktop_properties();
+	batch_commit();
+
+	if (focused)
+		set_input_focus(focused, True, False);
+	return True;
+}
+
+Bool restart_save(const char *path)
+{
+	/* like snapshot_init: never write through a file or link someone else left there */
+	unlink(path);
+	int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+	if (!f) {
+		if (fd >= 0)
+			close(fd);
+		return False;
+	}
+
+	RestartHeader hdr = {{'S', 'X', 'R', 'S'}, RESTART_VERSION, current_ws, previous_workspace, current_mon,
+	                     0, user_config.gaps, monocle, global_floating, {0}, focused ? focused->win : 0,
+	                     {0}, {0}, {0}};
+	for (int ws = 0; ws < NUM_WORKSPACES; ws++) {
+		hdr.ws_focused[ws] = ws_focused[ws] ? ws_focused[ws]->win : 0;
+		for (Client *c = workspaces[ws]; c; c = c->next)
+			hdr.n_clients++;
+	}
+	for (int i = 0; i < MAX_SCRATCHPADS; i++) {
+		hdr.scratchpads[i] = scratchpads[i].client ? scratchpads[i].client->win : 0;
+		hdr.sp_enabled[i] = scratchpads[i].enabled;
+	}
+	for (int i = 0; i < MAX_MONITORS; i++)
+		hdr.master_width[i] = user_config.master_width[i];
+
+	Bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+	for (int ws = 0; ws < NUM_WORKSPACES && ok; ws++) {
+		for (Client *c = workspaces[ws]; c && ok; c = c->next) {
+			RestartClient rc = {c->win, c->swallowed ? c->swallowed->win : 0, c->ws, c->mon,
+			                    c->x, c->y, c->w, c->h, c->orig_x, c->orig_y, c->orig_w, c->orig_h,
+			                    c->custom_stack_height, -1, c->fixed, c->floating, c->fullscreen, c->mapped,
+			                    c->offscreen, 0};
+			for (int i = 0; i < stack_n; i++)
+				if (stack_list[i] == c)
+					rc.stack = i;
+			if (c->pid > 0)
+				for (Client *s = swallow_index[(unsigned)c->pid % SWALLOW_INDEX_SIZE]; s; s = s->swallow_next)
+					if (s == c)
+						rc.can_swallow = 1;
+			ok = fwrite(&rc, sizeof(rc), 1, f) == 1;
+		}
+	}
+	return fclose(f) == 0 && ok;
+}
+
+void ring_begin(int kind, int type, Window w, unsigned long long start)
+{
+	/* filled before it is counted, so sig_ring never sees a half written slot */
+	if (ring_depth < RING_DEPTH)
+		ring_open[ring_depth] = (RingEntry){start, 0, (uint32_t)w, kind, type};
+	ring_depth++;
+}
+
+Bool ring_dump(void)
+{
+	/* called from sig_ring and sig_stall, so only async-signal-safe calls here */
+	if (ring_fd < 0 || ftruncate(ring_fd, 0) != 0)
+		return False;
+
+	unsigned long head = ring_head;
+	unsigned long n = MIN(head, RING_SIZE);
+	unsigned long first = (head - n) & (RING_SIZE - 1);
+	unsigned long wrap = MIN(n, RING_SIZE - first);
+	unsigned long open_n = MIN(ring_depth, RING_DEPTH);
+	RingHeader hdr = {{'S', 'X', 'R', 'B'}, RING_VERSION, n, open_n};
+
+	/* the open spans say what the main loop is in the middle of */
+	struct {
+		const void *p;
+		size_t n;
+	} parts[] = {
+		{&hdr, sizeof(hdr)},
+		{&ring[first], wrap * sizeof(RingEntry)},
+		{ring, (n - wrap) * sizeof(RingEntry)},
+		{ring_open, open_n * sizeof(RingEntry)},
+	};
+
+	/* explicit offsets, a dump from a signal may interrupt one from the main loop */
+	off_t off = 0;
+	for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+		if (pwrite(ring_fd, parts[i].p, parts[i].n, off) != (ssize_t)parts[i].n)
+			return False;
+		off += parts[i].n;
+	}
+	return True;
+}
+
+void ring_init(void)
+{
+	runtime_path(ring_path, sizeof(ring_path), "ring");
+
+	/* the /tmp fallback name is predictable: create it once here, never follow a link */
+	unlink(ring_path);
+	ring_fd = open(ring_path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (ring_fd < 0)
+		fprintf(stderr, "sxwm: cannot create %s\n", ring_path);
+}
+
+int ring_json(const char *path)
+{
+	RingHeader hdr;
+	FILE *f = fopen(path, "rb");
+	if (!f || fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, "SXRB", 4) != 0 ||
+	    hdr.version != RING_VERSION) {
+		fprintf(stderr, "sxwm: %s is not a ring dump\n", path);
+		if (f)
+			fclose(f);
+		return EXIT_FAILURE;
+	}
+
+	/* not running as a wm, so the ring itself holds the dump, open spans last */
+	size_t n = fread(ring, sizeof(RingEntry), MIN(hdr.count, RING_SIZE), f);
+	if (n == MIN(hdr.count, RING_SIZE))
+		n += fread(&ring[n], sizeof(RingEntry), MIN(hdr.open, MIN(RING_DEPTH, RING_SIZE - n)), f);
+	fclose(f);
+
+	/* entries are stored as they finish, nested ones before their parent */
+	unsigned long long base = n ? ring[0].start : 0;
+	for (size_t i = 1; i < n; i++)
+		base = MIN(base, ring[i].start);
+
+	/* Chrome trace event format, complete events in microseconds */
+	printf("{\"traceEvents\": [");
+	for (size_t i = 0; i < n; i++) {
+		RingEntry *e = &ring[i];
+		const char *name = ring_name(e->kind, e->type);
+
+		/* a span still running at dump time has no end, it only begins */
+		if (!e->end)
+			printf("%s\n  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"B\", \"pid\": 1, \"tid\": 1, "
+			       "\"ts\": %.3f, \"args\": {\"window\": \"0x%x\", \"in_progress\": true}}",
+			       i ? "," : "", name, e->kind == RING_EVENT ? "event" : "wm", (e->start - base) / 1e3,
+			       e->window);
+		else
+			printf("%s\n  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, "
+			       "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"window\": \"0x%x\"}}",
+			       i ? "," : "", name, e->kind == RING_EVENT ? "event" : "wm", (e->start - base) / 1e3,
+			       (e->end - e->start) / 1e3, e->window);
+	}
+	printf("\n]}\n");
+	return EXIT_SUCCESS;
+}
+
+const char *ring_name(int kind, int type)
+{
+	if (kind == RING_GRAB)
+		return "server grab";
+	if (kind == RING_TILE)
+		return "tile";
+	return type < LASTEvent && event_names[type] ? event_names[type] : "unknown";
+}
+
+void ring_push(int kind, int type, Window w, unsigned long long start)
+{
+	RingEntry *e = &ring[ring_head & (RING_SIZE - 1)];
+	e->start = start;
+	e->end = now_ns();
+	e->window = (uint32_t)w;
+	e->kind = kind;
+	e->type = type;
+	ring_head++;
+
+	/* spans end in the order they began */
+	if (ring_depth > 0)
+		ring_depth--;
+}
+
+void rt_begin(void)
+{
+	rt_start = now_ns();
+}
+
+long rt_end(const char *func, int line, long ret)
+{
+	unsigned long long took = now_ns() - rt_start;
+	RoundTripSite *rs = NULL;
+
+	for (int i = 0; i < rt_n_sites; i++) {
+		if (rt_sites[i].line == line && rt_sites[i].func == func) {
+			rs = &rt_sites[i];
+			break;
+		}
+	}
+	if (!rs) {
+		/* the table is sized for every call site, the last slot absorbs any excess */
+		rs = &rt_sites[rt_n_sites < RT_MAX_SITES ? rt_n_sites++ : RT_MAX_SITES - 1];
+		if (!rs->func) {
+			rs->func = func;
+			rs->line = line;
+		}
+	}
+	rs->calls++;
+	rs->ns += took;
+
+	stats.rt_calls[rt_event]++;
+	stats.rt_ns[rt_event] += took;
+	return ret;
+}
+
 void run(void)
 {
 	running = True;
 	XEvent xev;
 	while (running) {
-		XNextEvent(dpy, &xev);
-		xev_case(&xev);
+		while (running && XPending(dpy)) {
+			XNextEvent(dpy, &xev);
+			if (trace_file)
+				trace_record(&xev);
+			xev_case(&xev);
+		}
+		if (!running)
+			break;
+
+		tile_idle();
+		restack();
+		update_net_client_list();
+		ipc_publish();
+		snapshot_publish();
+		if (stats_requested) {
+			stats_requested = 0;
+			stats_dump();
+		}
+		/* sleep on the X connection and the ipc socket together */
+		if (!XPending(dpy))
+			ipc_poll();
+	}
+}
+
+void run_binding(const Binding *b)
+{
+	switch (b->type) {
+		case TYPE_CMD: if (b->action.cmd) spawn(b->action.cmd); break;
+		case TYPE_FUNC: if (b->action.fn) b->action.fn(); break;
+		case TYPE_WS_CHANGE: change_workspace(b->action.ws); update_net_client_list(); break;
+		case TYPE_WS_MOVE: move_to_workspace(b->action.ws); update_net_client_list(); break;
+		case TYPE_SP_REMOVE: remove_scratchpad(b->action.sp); break;
+		case TYPE_SP_TOGGLE: toggle_scratchpad(b->action.sp); break;
+		case TYPE_SP_CREATE: set_win_scratchpad(b->action.sp); break;
+		case TYPE_FOCUS: {
+			Client *c = find_client(b->action.win);
+			if (c && c->ws == current_ws)
+				set_input_focus(c, True, False);
+			break;
+		}
 	}
 }
 
+void runtime_path(char *buf, size_t size, const char *ext)
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	const char *display = getenv("DISPLAY");
+	char name[64];
+
+	snprintf(name, sizeof(name), "%s", display ? display : "");
+	for (char *p = name; *p; p++)
+		if (*p == '/')
+			*p = '_';
+
+	if (dir && *dir)
+		snprintf(buf, size, "%s/sxwm%s.%s", dir, name, ext);
+	else
+		snprintf(buf, size, "/tmp/sxwm-%u%s.%s", (unsigned)getuid(), name, ext);
+}
+
 void scan_existing_windows(void)
 {
 	Window root_return;
@@ -2127,17 +3694,26 @@ void scan_existing_windows(void)
 	unsigned int n_children;
 
 	if (XQueryTree(dpy, root, &root_return, &parent_return, &children, &n_children)) {
+		/* adopt everything, then lay out, publish and focus once */
+		Client *last = NULL;
+		batch_begin();
 		for (unsigned int i = 0; i < n_children; i++) {
 			XWindowAttributes wa;
-			if (!XGetWindowAttributes(dpy, children[i], &wa)
+			if (find_client(children[i]) || !XGetWindowAttributes(dpy, children[i], &wa)
 				|| wa.override_redirect || wa.map_state != IsViewable)
 				continue;
 
-			XEvent fake_event = {None};
-			fake_event.type = MapRequest;
-			fake_event.xmaprequest.window = children[i];
-			hdl_map_req(&fake_event);
+			manage_window(children[i], &wa);
+			/* docks and other windows left unmanaged are not focus candidates */
+			Client *c = find_client(children[i]);
+			if (c)
+				last = c;
+			startup_phase("adopt", children[i]);
 		}
+		batch_commit();
+
+		if (user_config.new_win_focus && last && last->ws == current_ws)
+			set_input_focus(last, True, True);
 		if (children)
 			XFree(children);
 	}
@@ -2148,30 +3724,34 @@ void select_input(Window w, Mask masks)
 	XSelectInput(dpy, w, masks);
 }
 
-void send_wm_take_focus(Window w)
-{
-	Atom wm_protocols = XInternAtom(dpy, "WM_PROTOCOLS", False);
-	Atom wm_take_focus = XInternAtom(dpy, "WM_TAKE_FOCUS", False);
-	Atom *protos;
-	int n;
-
-	if (XGetWMProtocols(dpy, w, &protos, &n)) {
-		for (int i = 0; i < n; i++) {
-			if (protos[i] == wm_take_focus) {
-				XEvent ev = {
-				    .xclient = {
-						.type = ClientMessage,
-						.window = w,
-						.message_type = wm_protocols,
-						.format = 32}
-				};
-				ev.xclient.data.l[0] = wm_take_focus;
-				ev.xclient.data.l[1] = CurrentTime;
-				XSendEvent(dpy, w, False, NoEventMask, &ev);
-			}
+void send_wm_take_focus(Client *c)
+{
+	/* WM_PROTOCOLS is read once and dropped again when it changes */
+	if (c->take_focus < 0) {
+		Atom *protos;
+		int n;
+
+		c->take_focus = 0;
+		if (XGetWMProtocols(dpy, c->win, &protos, &n)) {
+			for (int i = 0; i < n; i++)
+				if (protos[i] == atoms[ATOM_WM_TAKE_FOCUS])
+					c->take_focus = 1;
+			XFree(protos);
 		}
-		XFree(protos);
 	}
+	if (!c->take_focus)
+		return;
+
+	XEvent ev = {
+	    .xclient = {
+			.type = ClientMessage,
+			.window = c->win,
+			.message_type = atoms[ATOM_WM_PROTOCOLS],
+			.format = 32}
+	};
+	ev.xclient.data.l[0] = atoms[ATOM_WM_TAKE_FOCUS];
+	ev.xclient.data.l[1] = CurrentTime;
+	XSendEvent(dpy, c->win, False, NoEventMask, &ev);
 }
 
 void setup(void)
@@ -2181,32 +3761,62 @@ void setup(void)
 		exit(EXIT_FAILURE);
 	}
 	root = XDefaultRootWindow(dpy);
+	/* spawned clients must not hold on to our connection */
+	fcntl(ConnectionNumber(dpy), F_SETFD, FD_CLOEXEC);
+	startup_phase("open display", None);
+
+	/* set by restart in the process we replaced */
+	char restart_path[PATH_MAX] = "";
+	if (getenv("SXWM_RESTART")) {
+		snprintf(restart_path, sizeof(restart_path), "%s", getenv("SXWM_RESTART"));
+		unsetenv("SXWM_RESTART");
+	}
+
+	/* prevent child processes from becoming zombies */
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGUSR1, sig_stats);
+	signal(SIGUSR2, sig_ring);
+	/* caught before anything can tile, the first layout already arms the stall timer,
+	 * and sigaction so the handler is not reset to the default after one stall */
+	struct sigaction sa = {.sa_handler = sig_stall, .sa_flags = SA_RESTART};
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGALRM, &sa, NULL);
 
 	setup_atoms();
 	other_wm();
+	startup_phase("atoms, other wm check", None);
+	ipc_init();
+	snapshot_init();
+	ring_init();
+	startup_phase("ipc socket, state file, flight recorder", None);
 	init_defaults();
 	if (parser(&user_config)) {
 		fprintf(stderr, "sxwmrc: error parsing config file\n");
 		init_defaults();
 	}
+	startup_phase("config", None);
 	update_modifier_masks();
 	grab_keys();
-	startup_exec();
+	startup_phase("modifiers, key grabs", None);
+	if (!restart_path[0]) {
+		startup_exec();
+		startup_phase("autostart", None);
+	}
 
 	cursor_normal = XcursorLibraryLoadCursor(dpy, "left_ptr");
 	cursor_move = XcursorLibraryLoadCursor(dpy, "fleur");
 	cursor_resize = XcursorLibraryLoadCursor(dpy, "bottom_right_corner");
 	XDefineCursor(dpy, root, cursor_normal);
+	startup_phase("cursors", None);
 
 	scr_width = XDisplayWidth(dpy, DefaultScreen(dpy));
 	scr_height = XDisplayHeight(dpy, DefaultScreen(dpy));
 
 	update_mons();
+	startup_phase("monitors", None);
 
 	/* select events wm should look for on root */
-	Mask wm_masks = StructureNotifyMask | SubstructureRedirectMask | SubstructureNotifyMask |
-	                KeyPressMask | PropertyChangeMask;
-	select_input(root, wm_masks);
+	select_input(root, ROOT_EVENT_MASK);
 
 	/* grab mouse button events on root window */
 	Mask root_click_masks = ButtonPressMask | ButtonReleaseMask | PointerMotionMask;
@@ -2216,6 +3826,7 @@ void setup(void)
 	grab_button(Button1, user_config.modkey | ShiftMask, root, True, root_swap_masks);
 	grab_button(Button3, user_config.modkey, root, True, root_resize_masks);
 	XSync(dpy, False);
+	startup_phase("root input, sync", None);
 
 	for (int i = 0; i < LASTEvent; i++)
 		evtable[i] = hdl_dummy;
@@ -2225,16 +3836,20 @@ void setup(void)
 	evtable[ConfigureNotify] = hdl_config_ntf;
 	evtable[ConfigureRequest] = hdl_config_req;
 	evtable[DestroyNotify] = hdl_destroy_ntf;
+	evtable[EnterNotify] = hdl_crossing;
 	evtable[KeyPress] = hdl_keypress;
+	evtable[LeaveNotify] = hdl_crossing;
 	evtable[MappingNotify] = hdl_mapping_ntf;
 	evtable[MapRequest] = hdl_map_req;
 	evtable[MotionNotify] = hdl_motion;
 	evtable[PropertyNotify] = hdl_property_ntf;
 	evtable[UnmapNotify] = hdl_unmap_ntf;
+	/* windows are managed from here on, batch_commit does nothing otherwise */
+	running = True;
+	if (restart_path[0] && restart_restore(restart_path))
+		startup_phase("restore", None);
 	scan_existing_windows();
-
-	/* prevent child processes from becoming zombies */
-	signal(SIGCHLD, SIG_IGN);
+	startup_phase("ready", None);
 }
 
 void setup_atoms(void)
@@ -2275,6 +3890,39 @@ void setup_atoms(void)
 	update_workarea();
 }
 
+void set_active_window(Window w)
+{
+	if (w == active_pub)
+		return;
+
+	if (w == None)
+		XDeleteProperty(dpy, root, atoms[ATOM_NET_ACTIVE_WINDOW]);
+	else
+		XChangeProperty(dpy, root, atoms[ATOM_NET_ACTIVE_WINDOW], XA_WINDOW, 32,
+		                PropModeReplace, (unsigned char *)&w, 1);
+	active_pub = w;
+}
+
+void set_border_colour(Client *c, long col)
+{
+	/* a focus change only touches the old and the new focus */
+	if (c->border_col == col)
+		return;
+	XSetWindowBorder(dpy, c->win, col);
+	c->border_col = col;
+}
+
+void set_client_desktop(Client *c, int ws)
+{
+	if (c->desktop == ws)
+		return;
+
+	long desktop = ws;
+	XChangeProperty(dpy, c->win, atoms[ATOM_NET_WM_DESKTOP], XA_CARDINAL, 32,
+	                PropModeReplace, (unsigned char *)&desktop, 1);
+	c->desktop = ws;
+}
+
 void set_frame_extents(Window w)
 {
 	long extents[4] = {
@@ -2297,19 +3945,20 @@ void set_input_focus(Client *c, Bool raise_win, Bool warp)
 		if (c->ws >= 0 && c->ws < NUM_WORKSPACES)
 			ws_focused[c->ws] = c;
 
-		Window w = find_toplevel(c->win);
+		Window w = c->win;
+		PROBE2(focus, w, c->ws);
 
 		XSetInputFocus(dpy, w, RevertToPointerRoot, CurrentTime);
-		send_wm_take_focus(w);
+		send_wm_take_focus(c);
 
 		if (raise_win) {
 			/* always raise in monocle, otherwise respect floating_on_top */
 			if (monocle || c->floating || !user_config.floating_on_top)
-				XRaiseWindow(dpy, w);
+				raise_client(c);
 		}
-		/* EWMH focus hint */
-		XChangeProperty(dpy, root, atoms[ATOM_NET_ACTIVE_WINDOW], XA_WINDOW, 32,
-				PropModeReplace, (unsigned char *)&w, 1);
+		/* EWMH focus hint, a batch publishes it from update_borders */
+		if (!batching)
+			set_active_window(w);
 
 		update_borders();
 
@@ -2319,13 +3968,14 @@ void set_input_focus(Client *c, Bool raise_win, Bool warp)
 	else {
 		/* no client */
 		XSetInputFocus(dpy, root, RevertToPointerRoot, CurrentTime);
-		XDeleteProperty(dpy, root, atoms[ATOM_NET_ACTIVE_WINDOW]);
+		set_active_window(None);
 
 		focused = NULL;
 		ws_focused[current_ws] = NULL;
 		update_borders();
 	}
 
+	ipc_notify(IPC_EV_FOCUS);
 	XFlush(dpy);
 }
 
@@ -2372,6 +4022,148 @@ void set_wm_state(Window w, long state)
 			        PropModeReplace, (unsigned char *)data, 2);
 }
 
+void show_client(Client *c)
+{
+	if (c->offscreen) {
+		XMoveWindow(dpy, c->win, c->x, c->y);
+		c->offscreen = False;
+	}
+	XMapWindow(dpy, c->win);
+
+	set_wm_state(c->win, NormalState);
+	client_set_state(c, atoms[ATOM_NET_WM_STATE_HIDDEN], False);
+}
+
+void sig_ring(int sig)
+{
+	(void)sig;
+	/* written here rather than from the main loop, which may be the thing that is stuck */
+	int saved = errno;
+	ring_dump();
+	errno = saved;
+}
+
+void sig_stall(int sig)
+{
+	(void)sig;
+	/* the stuck handler is still on the stack, so no stdio and no malloc here */
+	int saved = errno;
+	char msg[512];
+	size_t n = stall_append(msg, 0, sizeof(msg), "sxwm: stall:");
+	int depth = MIN(ring_depth, RING_DEPTH);
+
+	/* outermost span first, each one inside the one before */
+	for (int i = 0; i < depth; i++) {
+		RingEntry *e = &ring_open[i];
+		n = stall_append(msg, n, sizeof(msg), i ? " in " : " ");
+		n = stall_append(msg, n, sizeof(msg), ring_name(e->kind, e->type));
+		if (e->window) {
+			n = stall_append(msg, n, sizeof(msg), " (window 0x");
+			n = stall_append_num(msg, n, sizeof(msg), e->window, 16);
+			n = stall_append(msg, n, sizeof(msg), ")");
+		}
+		if (i == 0) {
+			n = stall_append(msg, n, sizeof(msg), " still running after ");
+			n = stall_append_num(msg, n, sizeof(msg), (now_ns() - e->start) / 1000000, 10);
+			n = stall_append(msg, n, sizeof(msg), " ms");
+		}
+	}
+	if (ring_dump()) {
+		n = stall_append(msg, n, sizeof(msg), ", flight recorder in ");
+		n = stall_append(msg, n, sizeof(msg), ring_path);
+	}
+	n = stall_append(msg, n, sizeof(msg), "\n");
+	ssize_t written = write(STDERR_FILENO, msg, n);
+	(void)written; /* nowhere left to report a failed report */
+	errno = saved;
+}
+
+void sig_stats(int sig)
+{
+	(void)sig;
+	/* dumped from the main loop, nothing here is async-signal-safe */
+	stats_requested = 1;
+}
+
+void snapshot_cleanup(void)
+{
+	if (!snapshot)
+		return;
+
+	munmap(snapshot, sizeof(*snapshot));
+	unlink(snapshot_path);
+	snapshot = NULL;
+}
+
+void snapshot_init(void)
+{
+	runtime_path(snapshot_path, sizeof(snapshot_path), "state");
+
+	/* other_wm() already made sure no other sxwm owns this display */
+	unlink(snapshot_path);
+	int fd = open(snapshot_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "sxwm: cannot create %s\n", snapshot_path);
+		return;
+	}
+
+	void *p = MAP_FAILED;
+	if (ftruncate(fd, sizeof(Snapshot)) == 0)
+		p = mmap(NULL, sizeof(Snapshot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (p == MAP_FAILED) {
+		fprintf(stderr, "sxwm: cannot map %s\n", snapshot_path);
+		unlink(snapshot_path);
+		return;
+	}
+	snapshot = p;
+	snapshot->version = SNAPSHOT_VERSION;
+	snapshot->size = sizeof(Snapshot);
+	setenv("SXWM_STATE", snapshot_path, 1);
+}
+
+void snapshot_publish(void)
+{
+	if (!snapshot)
+		return;
+
+	Snapshot *next = &snapshot_next;
+	memset(next, 0, sizeof(*next));
+	next->version = SNAPSHOT_VERSION;
+	next->size = sizeof(Snapshot);
+	next->current_ws = current_ws;
+	next->current_mon = current_mon;
+	next->focused = focused ? focused->win : None;
+
+	for (int ws = 0; ws < NUM_WORKSPACES; ws++) {
+		for (Client *c = workspaces[ws]; c && next->n_clients < MAX_CLIENTS; c = c->next) {
+			SnapshotClient *sc = &next->clients[next->n_clients++];
+			sc->win = c->win;
+			sc->x = c->x;
+			sc->y = c->y;
+			sc->w = c->w;
+			sc->h = c->h;
+			sc->ws = ws;
+			sc->mon = c->mon;
+			sc->flags = (c->floating ? SNAP_FLOATING : 0) | (c->fullscreen ? SNAP_FULLSCREEN : 0) |
+			            (c->mapped ? SNAP_MAPPED : 0) | (c == focused ? SNAP_FOCUSED : 0);
+		}
+	}
+
+	/* seq is the first member, compare and copy everything after it */
+	size_t off = sizeof(next->seq);
+	if (memcmp((char *)snapshot + off, (char *)next + off, sizeof(Snapshot) - off) == 0)
+		return;
+
+	/* seqlock: an odd seq tells readers a write is in progress */
+	snapshot->seq++;
+	__sync_synchronize();
+	memcpy((char *)snapshot + off, (char *)next + off, sizeof(Snapshot) - off);
+	__sync_synchronize();
+	snapshot->seq++;
+}
+
 int snap_coordinate(int pos, int size, int screen_size, int snap_dist)
 {
 	if (UDIST(pos, 0) <= snap_dist)
@@ -2381,144 +4173,298 @@ int snap_coordinate(int pos, int size, int screen_size, int snap_dist)
 	return pos;
 }
 
-void spawn(const char * const *argv)
-{
-	int argc = 0;
-	while (argv[argc])
-		argc++;
+void spawn(const Command *cmd)
+{
+	/* replayed key presses must not launch anything */
+	if (replaying)
+		return;
+	PROBE2(spawn, cmd->stages[0][0], cmd->n_stages);
+
+	int pipes[MAX_PIPELINE - 1][2];
+	int n_pipes = 0;
+
+	for (; n_pipes < cmd->n_stages - 1; n_pipes++) {
+		if (pipe(pipes[n_pipes]) == -1) {
+			perror("pipe");
+			goto close_pipes;
+		}
+	}
+
+	/* children should not inherit our SIG_IGN for SIGCHLD */
+	posix_spawnattr_t attr;
+	sigset_t sig_default;
+	posix_spawnattr_init(&attr);
+	sigemptyset(&sig_default);
+	sigaddset(&sig_default, SIGCHLD);
+	posix_spawnattr_setsigdefault(&attr, &sig_default);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+	for (int i = 0; i < cmd->n_stages; i++) {
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+
+		if (i > 0)
+			posix_spawn_file_actions_adddup2(&actions, pipes[i - 1][0], STDIN_FILENO);
+		if (i < n_pipes)
+			posix_spawn_file_actions_adddup2(&actions, pipes[i][1], STDOUT_FILENO);
+
+		for (int k = 0; k < n_pipes; k++) {
+			posix_spawn_file_actions_addclose(&actions, pipes[k][0]);
+			posix_spawn_file_actions_addclose(&actions, pipes[k][1]);
+		}
+
+		pid_t pid;
+		int err = posix_spawnp(&pid, cmd->stages[i][0], &actions, &attr, cmd->stages[i], environ);
+		if (err)
+			fprintf(stderr, "sxwm: cannot spawn '%s': %s\n", cmd->stages[i][0], strerror(err));
 
-	int cmd_count = 1;
-	for (int i = 0; i < argc; i++) {
-		if (strcmp(argv[i], "|") == 0)
-			cmd_count++;
+		posix_spawn_file_actions_destroy(&actions);
 	}
+	posix_spawnattr_destroy(&attr);
 
-	const char ***commands = malloc(cmd_count * sizeof(char **)); /* *** bruh */
-	if (!commands) {
-		perror("malloc commands");
-		return;
+close_pipes:
+	for (int k = 0; k < n_pipes; k++) {
+		close(pipes[k][0]);
+		close(pipes[k][1]);
 	}
+}
 
-	/* initialize all command pointers to NULL for safe cleanup */
-	for (int i = 0; i < cmd_count; i++)
-		commands[i] = NULL;
+size_t stall_append(char *buf, size_t n, size_t size, const char *s)
+{
+	while (*s && n < size)
+		buf[n++] = *s++;
+	return n;
+}
 
-	int cmd_idx = 0;
-	int arg_start = 0;
-	for (int i = 0; i <= argc; i++) {
-		if (!argv[i] || strcmp(argv[i], "|") == 0) {
-			int len = i - arg_start;
-			const char **cmd_args = malloc((len + 1) * sizeof(char *));
+size_t stall_append_num(char *buf, size_t n, size_t size, unsigned long long v, int base)
+{
+	char digits[24];
+	int len = 0;
 
-			if (!cmd_args) {
-				perror("malloc cmd_args");
+	do {
+		digits[len++] = "0123456789abcdef"[v % base];
+		v /= base;
+	} while (v);
+	while (len && n < size)
+		buf[n++] = digits[--len];
+	return n;
+}
 
-				for (int j = 0; j < cmd_idx; j++)
-					free(commands[j]);
+void stall_arm(void)
+{
+	/* one shot, so a handler that never returns is reported once, while it is stuck */
+	if (stall_armed) {
+		stall_armed++;
+		return;
+	}
+	if (!user_config.stall_budget)
+		return;
+	struct itimerval it = {{0, 0}, {user_config.stall_budget / 1000, user_config.stall_budget % 1000 * 1000}};
+	setitimer(ITIMER_REAL, &it, NULL);
+	stall_armed = 1;
+}
 
-				free(commands);
-				return;
-			}
+void stall_check(const char *what, Window w, unsigned long long start)
+{
+	if (!user_config.stall_budget)
+		return;
 
-			for (int j = 0; j < len; j++)
-				cmd_args[j] = argv[arg_start + j];
+	/* measured after the fact, so nothing runs unless the budget was blown */
+	unsigned long long took = now_ns() - start;
+	if (took < (unsigned long long)user_config.stall_budget * 1000000)
+		return;
 
-			cmd_args[len] = NULL;
-			commands[cmd_idx++] = cmd_args;
-			arg_start = i + 1;
-		}
-	}
+	fprintf(stderr, "sxwm: stall: %s took %.1f ms (budget %d ms), window 0x%lx, workspace %d, %d clients\n",
+	        what, took / 1e6, user_config.stall_budget, w, current_ws + 1, open_windows);
+}
 
-	int (*pipes)[2] = malloc(sizeof(int[2]) * (cmd_count - 1));
-	if (!pipes) {
-		perror("malloc pipes");
+void startup_phase(const char *what, Window w)
+{
+	if (!startup_start)
+		return;
 
-		for (int j = 0; j < cmd_count; j++)
-			free(commands[j]);
+	unsigned long long now = now_ns();
+	unsigned long requests = XNextRequest(dpy) - 1;
+	unsigned long rt = 0;
+	for (int i = 0; i < LASTEvent; i++)
+		rt += stats.rt_calls[i];
+
+	/* queued requests are paid for at the next blocking call, not in the phase that sent them */
+	fprintf(stderr, "sxwm: startup %9.3f ms %+9.3f ms %5lu requests %4lu round trips  %s",
+	        (now - startup_start) / 1e6, (now - startup_last) / 1e6, requests - startup_requests,
+	        rt - startup_rt, what);
+	if (w)
+		fprintf(stderr, " 0x%lx", w);
+	fputc('\n', stderr);
+
+	startup_last = now;
+	startup_requests = requests;
+	startup_rt = rt;
+}
 
-		free(commands);
+void stall_disarm(void)
+{
+	if (!stall_armed || --stall_armed)
 		return;
-	}
+	struct itimerval it = {{0, 0}, {0, 0}};
+	setitimer(ITIMER_REAL, &it, NULL);
+}
 
-	for (int i = 0; i < cmd_count - 1; i++) {
-		if (pipe(pipes[i]) == -1) {
-			perror("pipe");
+void startup_exec(void)
+{
+	for (int i = 0; i < MAX_ITEMS; i++)
+		if (user_config.to_run[i])
+			spawn(user_config.to_run[i]);
+}
 
-			for (int j = 0; j < cmd_count; j++)
-				free(commands[j]);
+void stats_dump(void)
+{
+	ipc_msg_len = 0;
+	stats_format();
+	fwrite(ipc_msg, 1, ipc_msg_len, stderr);
+	fflush(stderr);
+}
 
-			free(commands);
-			free(pipes);
-			return;
-		}
+void stats_format(void)
+{
+	ipc_printf("# HELP sxwm_events_total X events handled, by type.\n"
+	           "# TYPE sxwm_events_total counter\n");
+	for (int i = 0; i < LASTEvent; i++)
+		if (event_names[i])
+			ipc_printf("sxwm_events_total{type=\"%s\"} %lu\n", event_names[i], stats.events[i]);
+
+	ipc_printf("# HELP sxwm_tile_total Layouts of the current workspace.\n"
+	           "# TYPE sxwm_tile_total counter\n"
+	           "sxwm_tile_total %lu\n", stats.tiles);
+	ipc_printf("# HELP sxwm_configure_total Tiled geometry changes, sent or skipped as unchanged.\n"
+	           "# TYPE sxwm_configure_total counter\n"
+	           "sxwm_configure_total{result=\"sent\"} %lu\n"
+	           "sxwm_configure_total{result=\"skipped\"} %lu\n", stats.configures, stats.configures_skipped);
+	ipc_printf("# HELP sxwm_border_updates_total Border colour passes.\n"
+	           "# TYPE sxwm_border_updates_total counter\n"
+	           "sxwm_border_updates_total %lu\n", stats.border_updates);
+	ipc_printf("# HELP sxwm_xsync_total Explicit XSync round trips.\n"
+	           "# TYPE sxwm_xsync_total counter\n"
+	           "sxwm_xsync_total %lu\n", stats.syncs);
+	unsigned long rt_calls = 0;
+	unsigned long long rt_ns = 0;
+	for (int i = 0; i < LASTEvent; i++) {
+		rt_calls += stats.rt_calls[i];
+		rt_ns += stats.rt_ns[i];
 	}
+	ipc_printf("# HELP sxwm_round_trips_total Blocking Xlib calls, see the roundtrips request.\n"
+	           "# TYPE sxwm_round_trips_total counter\n"
+	           "sxwm_round_trips_total %lu\n", rt_calls);
+	ipc_printf("# HELP sxwm_round_trip_seconds_total Time spent waiting in blocking Xlib calls.\n"
+	           "# TYPE sxwm_round_trip_seconds_total counter\n"
+	           "sxwm_round_trip_seconds_total %.6f\n", rt_ns / 1e9);
+	ipc_printf("# HELP sxwm_x_requests_total Requests sent to the X server.\n"
+	           "# TYPE sxwm_x_requests_total counter\n"
+	           "sxwm_x_requests_total %lu\n", XNextRequest(dpy) - 1);
+	ipc_printf("# HELP sxwm_x_requests_by_event_total Requests sent while handling each event type.\n"
+	           "# TYPE sxwm_x_requests_by_event_total counter\n");
+	for (int i = 0; i < LASTEvent; i++)
+		if (event_names[i] && stats.events[i])
+			ipc_printf("sxwm_x_requests_by_event_total{type=\"%s\"} %lu\n", event_names[i], stats.requests[i]);
+	ipc_printf("# HELP sxwm_workspace_grab_total Server grabs taken to switch workspaces.\n"
+	           "# TYPE sxwm_workspace_grab_total counter\n"
+	           "sxwm_workspace_grab_total %lu\n", stats.grabs);
+	ipc_printf("# HELP sxwm_workspace_grab_seconds_total Time the server was grabbed for workspace switches.\n"
+	           "# TYPE sxwm_workspace_grab_seconds_total counter\n"
+	           "sxwm_workspace_grab_seconds_total %.6f\n", stats.grab_ns / 1e9);
+	ipc_printf("# HELP sxwm_clients Clients currently managed.\n"
+	           "# TYPE sxwm_clients gauge\n"
+	           "sxwm_clients %d\n", open_windows);
+	ipc_printf("# HELP sxwm_clients_added_total Clients taken under management.\n"
+	           "# TYPE sxwm_clients_added_total counter\n"
+	           "sxwm_clients_added_total %lu\n", stats.clients_added);
+	ipc_printf("# HELP sxwm_clients_removed_total Clients released from management.\n"
+	           "# TYPE sxwm_clients_removed_total counter\n"
+	           "sxwm_clients_removed_total %lu\n", stats.clients_removed);
+
+	if (!user_config.handler_timing)
+		return;
 
-	for (int i = 0; i < cmd_count; i++) {
-		if (!commands[i] || !commands[i][0])
+	ipc_printf("# HELP sxwm_handler_seconds Time spent in each event handler, by event type.\n"
+	           "# TYPE sxwm_handler_seconds histogram\n");
+	for (int i = 0; i < LASTEvent; i++) {
+		unsigned long count = 0;
+		for (int b = 0; b < HIST_BUCKETS; b++)
+			count += stats.hist[i][b];
+		if (!count || !event_names[i])
 			continue;
 
-		pid_t pid = fork();
-		if (pid < 0) {
-			perror("fork");
+		unsigned long cumulative = 0;
+		for (int b = 0; b < HIST_BUCKETS - 1; b++) {
+			cumulative += stats.hist[i][b];
+			ipc_printf("sxwm_handler_seconds_bucket{type=\"%s\",le=\"%g\"} %lu\n", event_names[i],
+			           (double)(1UL << b) / 1e6, cumulative);
+		}
+		ipc_printf("sxwm_handler_seconds_bucket{type=\"%s\",le=\"+Inf\"} %lu\n", event_names[i], count);
+		ipc_printf("sxwm_handler_seconds_sum{type=\"%s\"} %.6f\n", event_names[i], stats.hist_ns[i] / 1e9);
+		ipc_printf("sxwm_handler_seconds_count{type=\"%s\"} %lu\n", event_names[i], count);
+	}
+}
 
-			for (int k = 0; k < cmd_count - 1; k++) {
-				close(pipes[k][0]);
-				close(pipes[k][1]);
-			}
+void stats_json(unsigned long n, double elapsed_ms)
+{
+	unsigned long rt_calls = 0;
+	for (int i = 0; i < LASTEvent; i++)
+		rt_calls += stats.rt_calls[i];
 
-			for (int j = 0; j < cmd_count; j++)
-				free(commands[j]);
+	ipc_printf("{\"events\": %lu, \"elapsed_ms\": %.3f, \"x_requests\": %lu, \"round_trips\": %lu, "
+	           "\"tiles\": %lu, \"configures\": %lu, \"configures_skipped\": %lu, \"handlers\": {",
+	           n, elapsed_ms, XNextRequest(dpy) - 1, rt_calls, stats.tiles, stats.configures,
+	           stats.configures_skipped);
 
-			free(commands);
-			free(pipes);
-			return;
-		}
-		if (pid == 0) {
-			close(ConnectionNumber(dpy));
+	const char *sep = "";
+	for (int i = 0; i < LASTEvent; i++) {
+		if (!event_names[i] || !stats.events[i])
+			continue;
+		ipc_printf("%s\n  \"%s\": {\"count\": %lu, \"p50_us\": %lu, \"p99_us\": %lu, \"total_ms\": %.3f, "
+		           "\"x_requests\": %lu, \"round_trips\": %lu, \"max_round_trips\": %lu}",
+		           sep, event_names[i], stats.events[i], hist_percentile(i, 0.5), hist_percentile(i, 0.99),
+		           stats.hist_ns[i] / 1e6, stats.requests[i], stats.rt_calls[i], stats.rt_max[i]);
+		sep = ",";
+	}
+	ipc_printf("\n}}\n");
+}
 
-			if (i > 0)
-				dup2(pipes[i - 1][0], STDIN_FILENO);
+void swallow_index_add(Client *c)
+{
+	Client **bucket = &swallow_index[(unsigned)c->pid % SWALLOW_INDEX_SIZE];
+	c->swallow_next = *bucket;
+	*bucket = c;
+}
 
-			if (i < cmd_count - 1)
-				dup2(pipes[i][1], STDOUT_FILENO);
+void swallow_index_rebuild(void)
+{
+	memset(swallow_index, 0, sizeof(swallow_index));
 
-			for (int k = 0; k < cmd_count - 1; k++) {
-				close(pipes[k][0]);
-				close(pipes[k][1]);
-			}
+	for (int ws = 0; ws < NUM_WORKSPACES; ws++) {
+		for (Client *c = workspaces[ws]; c; c = c->next) {
+			XClassHint ch = {0};
+			c->swallow_next = NULL;
+			if (c->pid <= 0 || !XGetClassHint(dpy, c->win, &ch))
+				continue;
 
-			execvp(commands[i][0], (char* const*)(void*)commands[i]);
-			fprintf(stderr, "sxwm: execvp '%s' failed\n", commands[i][0]);
-			exit(EXIT_FAILURE);
+			if (match_class(&ch, user_config.can_swallow))
+				swallow_index_add(c);
+			XFree(ch.res_class);
+			XFree(ch.res_name);
 		}
 	}
-
-	for (int i = 0; i < cmd_count - 1; i++) {
-		close(pipes[i][0]);
-		close(pipes[i][1]);
-	}
-
-	for (int i = 0; i < cmd_count; i++)
-		free(commands[i]);
-
-	free(commands);
-	free(pipes);
 }
 
-void startup_exec(void)
+void swallow_index_remove(Client *c)
 {
-	for (int i = 0; i < MAX_ITEMS; i++) {
-		if (user_config.to_run[i]) {
-			const char **argv = build_argv(user_config.to_run[i]);
-			if (argv) {
-				spawn(argv);
-				for (int j = 0; argv[j]; j++)
-					free((void*)(uintptr_t)argv[j]);
+	Client **pp = &swallow_index[(unsigned)c->pid % SWALLOW_INDEX_SIZE];
+	while (*pp && *pp != c)
+		pp = &(*pp)->swallow_next;
 
-				free(argv);
-			}
-		}
-	}
+	if (*pp)
+		*pp = c->swallow_next;
+	c->swallow_next = NULL;
 }
 
 void swallow_window(Client *swallower, Client *swallowed)
@@ -2593,8 +4539,52 @@ void switch_previous_workspace(void)
 
 void tile(void)
 {
-	update_struts();
-	Client *head = workspaces[current_ws];
+	if (batching) {
+		deferred |= DEFER_TILE;
+		return;
+	}
+	stats.tiles++;
+	unsigned long long start = now_ns();
+	ring_begin(RING_TILE, 0, None, start);
+	stall_arm();
+	PROBE2(tile_start, current_ws, open_windows);
+
+	/* rescanning the root children costs a round trip per window */
+	if (struts_stale)
+		update_struts();
+	tile_ws(current_ws);
+	ipc_notify(IPC_EV_LAYOUT);
+
+	/* monitors, struts, gaps or layout settings changed, refresh hidden workspaces when idle */
+	uint64_t h = layout_hash();
+	if (h != ws_layout_hash) {
+		for (int ws = 0; ws < NUM_WORKSPACES; ws++)
+			if (ws != current_ws && workspaces[ws])
+				ws_dirty[ws] = True;
+		ws_layout_hash = h;
+	}
+	stall_disarm();
+	ring_push(RING_TILE, 0, None, start);
+	stall_check("tile", None, start);
+	PROBE1(tile_done, current_ws);
+}
+
+void tile_idle(void)
+{
+	/* one workspace at a time so pending events are never held back */
+	for (int ws = 0; ws < NUM_WORKSPACES && !XPending(dpy); ws++) {
+		if (ws == current_ws || !ws_dirty[ws])
+			continue;
+
+		tile_ws(ws);
+		ws_dirty[ws] = False;
+	}
+}
+
+void tile_ws(int ws)
+{
+	Client *head = workspaces[ws];
+	Bool shown = ws == current_ws;
 	int total = 0;
 
 	for (Client *c = head; c; c = c->next) {
@@ -2626,8 +4616,14 @@ void tile(void)
 				.height = MAX(1, h - 2 * border_width),
 				.border_width = border_width
 			};
-			XConfigureWindow(dpy, c->win,
-					CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &wc);
+
+			Bool geom_differ =
+				c->x != wc.x || c->y != wc.y ||
+				c->w != wc.width || c->h != wc.height;
+			if (geom_differ)
+				configure_client(c, &wc);
+			else
+				stats.configures_skipped++;
 
 			c->x = wc.x;
 			c->y = wc.y;
@@ -2635,8 +4631,11 @@ void tile(void)
 			c->h = wc.height;
 		}
 
+		if (!shown)
+			return;
+
 		if (focused && focused->mapped && !focused->floating && !focused->fullscreen)
-			XRaiseWindow(dpy, focused->win);
+			raise_client(focused);
 
 		update_borders();
 		return;
@@ -2682,7 +4681,9 @@ void tile(void)
 				c->x != wc.x || c->y != wc.y ||
 				c->w != wc.width || c->h != wc.height;
 			if (geom_differ)
-				XConfigureWindow(dpy, c->win, CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &wc);
+				configure_client(c, &wc);
+			else
+				stats.configures_skipped++;
 
 			c->x = wc.x;
 			c->y = wc.y;
@@ -2691,7 +4692,8 @@ void tile(void)
 		}
 
 		if (n_tileable == 1) {
-			update_borders();
+			if (shown)
+				update_borders();
 			continue;
 		}
 
@@ -2775,7 +4777,9 @@ void tile(void)
 				c->x != wc.x || c->y != wc.y ||
 				c->w != wc.width || c->h != wc.height;
 			if (geom_differ)
-				XConfigureWindow(dpy, c->win, CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &wc);
+				configure_client(c, &wc);
+			else
+				stats.configures_skipped++;
 
 			c->x = wc.x;
 			c->y = wc.y;
@@ -2784,7 +4788,8 @@ void tile(void)
 
 			stack_y += heights_final[i] + gaps;
 		}
-		update_borders();
+		if (shown)
+			update_borders();
 	}
 }
 
@@ -2855,7 +4860,7 @@ void toggle_floating_global(void)
 
 			XConfigureWindow(dpy, c->win, CWX | CWY | CWWidth | CWHeight,
 			                 &(XWindowChanges){.x = c->x, .y = c->y, .width = c->w, .height = c->h});
-			XRaiseWindow(dpy, c->win);
+			raise_client(c);
 		}
 	}
 
@@ -2895,14 +4900,13 @@ void toggle_scratchpad(int n)
 
 		if (*pp)
 			*pp = c->next;
+		ws_dirty[c->ws] = True;
 
 		/* link to current workspace */
 		c->next = workspaces[current_ws];
 		workspaces[current_ws] = c;
 		c->ws = current_ws;
-
-		long desktop = current_ws;
-		XChangeProperty(dpy, c->win, atoms[ATOM_NET_WM_DESKTOP], XA_CARDINAL, 32, PropModeReplace, (unsigned char *)&desktop, 1);
+		set_client_desktop(c, current_ws);
 	}
 
 	c->mon = CLAMP(focused ? focused->mon : current_mon, 0, n_mons - 1);
@@ -2926,6 +4930,288 @@ void toggle_scratchpad(int n)
 	update_net_client_list();
 }
 
+Atom trace_decode_atom(int32_t v)
+{
+	if (v >= TRACE_ATOM_BASE && v < TRACE_ATOM_BASE + ATOM_COUNT)
+		return atoms[v - TRACE_ATOM_BASE];
+	return (Atom)v;
+}
+
+int32_t trace_encode_atom(Atom a)
+{
+	/* predefined atoms are the same on every server, ours are stored by name index */
+	if (a <= XA_LAST_PREDEFINED)
+		return (int32_t)a;
+	for (int i = 0; i < ATOM_COUNT; i++)
+		if (atoms[i] == a)
+			return TRACE_ATOM_BASE + i;
+	return None;
+}
+
+void trace_event(const TraceRecord *r, XEvent *xev)
+{
+	memset(xev, 0, sizeof(*xev));
+	xev->type = r->type;
+	xev->xany.display = dpy;
+	xev->xany.window = trace_window(r->window);
+
+	switch (r->type) {
+		case KeyPress:
+		case KeyRelease:
+			xev->xkey.root = root;
+			xev->xkey.keycode = r->v[0];
+			xev->xkey.state = r->v[1];
+			break;
+		case ButtonPress:
+		case ButtonRelease:
+			xev->xbutton.root = root;
+			xev->xbutton.subwindow = trace_window(r->extra);
+			xev->xbutton.button = r->v[0];
+			xev->xbutton.state = r->v[1];
+			xev->xbutton.x_root = r->v[2];
+			xev->xbutton.y_root = r->v[3];
+			xev->xbutton.x = r->v[4];
+			xev->xbutton.y = r->v[5];
+			break;
+		case MotionNotify:
+			xev->xmotion.root = root;
+			xev->xmotion.subwindow = trace_window(r->extra);
+			xev->xmotion.state = r->v[0];
+			xev->xmotion.x_root = r->v[1];
+			xev->xmotion.y_root = r->v[2];
+			xev->xmotion.x = r->v[3];
+			xev->xmotion.y = r->v[4];
+			xev->xmotion.time = (Time)(uint32_t)r->v[5];
+			break;
+		case MapRequest:
+			xev->xmaprequest.parent = root;
+			xev->xmaprequest.window = trace_window(r->window);
+			break;
+		case ConfigureRequest:
+			xev->xconfigurerequest.parent = root;
+			xev->xconfigurerequest.window = trace_window(r->window);
+			xev->xconfigurerequest.above = trace_window(r->extra);
+			xev->xconfigurerequest.x = r->v[0];
+			xev->xconfigurerequest.y = r->v[1];
+			xev->xconfigurerequest.width = r->v[2];
+			xev->xconfigurerequest.height = r->v[3];
+			xev->xconfigurerequest.border_width = r->v[4];
+			xev->xconfigurerequest.value_mask = r->v[5];
+			xev->xconfigurerequest.detail = r->v[6];
+			break;
+		case ConfigureNotify:
+			xev->xconfigure.event = trace_window(r->extra);
+			xev->xconfigure.window = trace_window(r->window);
+			xev->xconfigure.x = r->v[0];
+			xev->xconfigure.y = r->v[1];
+			xev->xconfigure.width = r->v[2];
+			xev->xconfigure.height = r->v[3];
+			break;
+		case DestroyNotify:
+			xev->xdestroywindow.event = trace_window(r->extra);
+			xev->xdestroywindow.window = trace_window(r->window);
+			break;
+		case UnmapNotify:
+			xev->xunmap.event = trace_window(r->extra);
+			xev->xunmap.window = trace_window(r->window);
+			xev->xunmap.from_configure = r->v[0];
+			break;
+		case PropertyNotify:
+			xev->xproperty.atom = trace_decode_atom(r->v[0]);
+			xev->xproperty.state = r->v[1];
+			break;
+		case ClientMessage:
+			xev->xclient.message_type = trace_decode_atom(r->v[0]);
+			xev->xclient.format = r->v[1];
+			for (int i = 0; i < 5; i++)
+				xev->xclient.data.l[i] = r->v[2 + i];
+			if (xev->xclient.message_type == atoms[ATOM_NET_WM_STATE]) {
+				xev->xclient.data.l[1] = trace_decode_atom(r->v[3]);
+				xev->xclient.data.l[2] = trace_decode_atom(r->v[4]);
+			}
+			break;
+		case MappingNotify:
+			xev->xmapping.request = r->v[0];
+			xev->xmapping.first_keycode = r->v[1];
+			xev->xmapping.count = r->v[2];
+			break;
+	}
+}
+
+void trace_record(XEvent *xev)
+{
+	TraceRecord r = {0};
+	r.time = now_ns() - trace_start_ns;
+	r.type = xev->type;
+	r.window = xev->xany.window;
+
+	switch (xev->type) {
+		case KeyPress:
+		case KeyRelease:
+			r.v[0] = xev->xkey.keycode;
+			r.v[1] = xev->xkey.state;
+			break;
+		case ButtonPress:
+		case ButtonRelease:
+			r.extra = xev->xbutton.subwindow;
+			r.v[0] = xev->xbutton.button;
+			r.v[1] = xev->xbutton.state;
+			r.v[2] = xev->xbutton.x_root;
+			r.v[3] = xev->xbutton.y_root;
+			r.v[4] = xev->xbutton.x;
+			r.v[5] = xev->xbutton.y;
+			break;
+		case MotionNotify:
+			r.extra = xev->xmotion.subwindow;
+			r.v[0] = xev->xmotion.state;
+			r.v[1] = xev->xmotion.x_root;
+			r.v[2] = xev->xmotion.y_root;
+			r.v[3] = xev->xmotion.x;
+			r.v[4] = xev->xmotion.y;
+			r.v[5] = (int32_t)xev->xmotion.time;
+			break;
+		case MapRequest:
+			r.window = xev->xmaprequest.window;
+			break;
+		case ConfigureRequest:
+			r.window = xev->xconfigurerequest.window;
+			r.extra = xev->xconfigurerequest.above;
+			r.v[0] = xev->xconfigurerequest.x;
+			r.v[1] = xev->xconfigurerequest.y;
+			r.v[2] = xev->xconfigurerequest.width;
+			r.v[3] = xev->xconfigurerequest.height;
+			r.v[4] = xev->xconfigurerequest.border_width;
+			r.v[5] = xev->xconfigurerequest.value_mask;
+			r.v[6] = xev->xconfigurerequest.detail;
+			break;
+		case ConfigureNotify:
+			r.window = xev->xconfigure.window;
+			r.extra = xev->xconfigure.event;
+			r.v[0] = xev->xconfigure.x;
+			r.v[1] = xev->xconfigure.y;
+			r.v[2] = xev->xconfigure.width;
+			r.v[3] = xev->xconfigure.height;
+			break;
+		case DestroyNotify:
+			r.window = xev->xdestroywindow.window;
+			r.extra = xev->xdestroywindow.event;
+			break;
+		case UnmapNotify:
+			r.window = xev->xunmap.window;
+			r.extra = xev->xunmap.event;
+			r.v[0] = xev->xunmap.from_configure;
+			break;
+		case PropertyNotify:
+			r.v[0] = trace_encode_atom(xev->xproperty.atom);
+			r.v[1] = xev->xproperty.state;
+			break;
+		case ClientMessage:
+			r.v[0] = trace_encode_atom(xev->xclient.message_type);
+			r.v[1] = xev->xclient.format;
+			for (int i = 0; i < 5; i++)
+				r.v[2 + i] = (int32_t)xev->xclient.data.l[i];
+			if (xev->xclient.message_type == atoms[ATOM_NET_WM_STATE]) {
+				r.v[3] = trace_encode_atom(xev->xclient.data.l[1]);
+				r.v[4] = trace_encode_atom(xev->xclient.data.l[2]);
+			}
+			break;
+		case MappingNotify:
+			r.v[0] = xev->xmapping.request;
+			r.v[1] = xev->xmapping.first_keycode;
+			r.v[2] = xev->xmapping.count;
+			break;
+	}
+
+	fwrite(&r, sizeof(r), 1, trace_file);
+}
+
+int trace_replay(const char *path)
+{
+	TraceHeader hdr;
+	FILE *f = fopen(path, "rb");
+	if (!f || fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, "SXTR", 4) != 0 ||
+	    hdr.version != TRACE_VERSION) {
+		fprintf(stderr, "sxwm: %s is not a trace\n", path);
+		if (f)
+			fclose(f);
+		return EXIT_FAILURE;
+	}
+	trace_root = hdr.root;
+
+	replaying = True;
+	setup();
+	user_config.handler_timing = True;
+	running = True;
+
+	XEvent xev;
+	TraceRecord r;
+	unsigned long n = 0;
+	unsigned long long start = now_ns();
+
+	while (running && fread(&r, sizeof(r), 1, f) == 1) {
+		if (r.type == DestroyNotify) {
+			Window w = trace_window(r.window);
+			if (w != root)
+				XDestroyWindow(dpy, w);
+		}
+		trace_event(&r, &xev);
+		xev_case(&xev);
+		n++;
+
+		/* the trace already holds every event the session produced, drop the real ones */
+		while (running && XPending(dpy))
+			XNextEvent(dpy, &xev);
+	}
+	fclose(f);
+
+	if (running) {
+		XSync(dpy, False);
+		ipc_msg_len = 0;
+		stats_json(n, (now_ns() - start) / 1e6);
+		fwrite(ipc_msg, 1, ipc_msg_len, stdout);
+		fflush(stdout);
+		quit();
+	}
+	return EXIT_SUCCESS;
+}
+
+void trace_start(const char *path)
+{
+	TraceHeader hdr = {.magic = "SXTR", .version = TRACE_VERSION, .root = root};
+
+	if (!(trace_file = fopen(path, "wb")) || fwrite(&hdr, sizeof(hdr), 1, trace_file) != 1) {
+		fprintf(stderr, "sxwm: cannot record to %s\n", path);
+		if (trace_file)
+			fclose(trace_file);
+		trace_file = NULL;
+		return;
+	}
+	fcntl(fileno(trace_file), F_SETFD, FD_CLOEXEC);
+	trace_start_ns = now_ns();
+}
+
+Window trace_window(uint64_t id)
+{
+	if (id == None)
+		return None;
+	if (id == trace_root)
+		return root;
+
+	/* open addressing, entries are never removed during a replay */
+	unsigned int slot = id % TRACE_WIN_SLOTS;
+	for (unsigned int i = 0; i < TRACE_WIN_SLOTS; i++, slot = (slot + 1) % TRACE_WIN_SLOTS) {
+		TraceWindow *tw = &trace_windows[slot];
+		if (tw->from == id)
+			return tw->to;
+		if (tw->from == 0) {
+			tw->from = id;
+			tw->to = XCreateSimpleWindow(dpy, root, 0, 0, 100, 100, 0, 0, 0);
+			return tw->to;
+		}
+	}
+	return None;
+}
+
 void unswallow_window(Client *c)
 {
 	if (!c || !c->swallower)
@@ -2951,29 +5237,37 @@ void unswallow_window(Client *c)
 		tile();
 		update_borders();
 	}
+	else if (ws >= 0 && ws < NUM_WORKSPACES) {
+		ws_dirty[ws] = True;
+	}
 }
 
 void update_borders(void)
 {
+	if (batching) {
+		deferred |= DEFER_BORDERS;
+		return;
+	}
+	stats.border_updates++;
+
 	for (Client *c = workspaces[current_ws]; c; c = c->next)
-		XSetWindowBorder(dpy, c->win, (c == focused ? user_config.border_foc_col : user_config.border_ufoc_col));
+		set_border_colour(c, c == focused ? user_config.border_foc_col : user_config.border_ufoc_col);
 
-	if (focused) {
-		Window w = focused->win;
-		XChangeProperty(dpy, root, atoms[ATOM_NET_ACTIVE_WINDOW], XA_WINDOW, 32,
-				        PropModeReplace, (unsigned char *)&w, 1);
-	}
+	if (focused)
+		set_active_window(focused->win);
 }
 
 void update_client_desktop_properties(void)
 {
-	for (int ws = 0; ws < NUM_WORKSPACES; ws++) {
-		for (Client *c = workspaces[ws]; c; c = c->next) {
-			long desktop = ws;
-			XChangeProperty(dpy, c->win, atoms[ATOM_NET_WM_DESKTOP], XA_CARDINAL, 32,
-					        PropModeReplace, (unsigned char *)&desktop, 1);
-		}
+	if (batching) {
+		deferred |= DEFER_DESKTOPS;
+		return;
 	}
+
+	/* only clients whose workspace changed since the last write */
+	for (int ws = 0; ws < NUM_WORKSPACES; ws++)
+		for (Client *c = workspaces[ws]; c; c = c->next)
+			set_client_desktop(c, ws);
 }
 
 void update_modifier_masks(void)
@@ -3040,21 +5334,38 @@ void update_mons(void)
 	}
 
 	free(old);
+	struts_stale = True;
+	ipc_notify(IPC_EV_MONITOR);
 }
 
 void update_net_client_list(void)
 {
-	Window wins[MAX_CLIENTS];
-	int n = 0;
-	for (int ws = 0; ws < NUM_WORKSPACES; ws++)
-		for (Client *c = workspaces[ws]; c; c = c->next)
-			wins[n++] = c->win;
+	if (batching) {
+		deferred |= DEFER_CLIENT_LIST;
+		return;
+	}
 
-	XChangeProperty(dpy, root, atoms[ATOM_NET_CLIENT_LIST], XA_WINDOW, 32, PropModeReplace, (unsigned char *)wins, n);
+	/* only removals rewrite the list, new clients are appended */
+	if (client_list_stale)
+		XChangeProperty(dpy, root, atoms[ATOM_NET_CLIENT_LIST], XA_WINDOW, 32, PropModeReplace,
+		                (unsigned char *)client_list, client_list_n);
+	else if (client_list_pub < client_list_n)
+		XChangeProperty(dpy, root, atoms[ATOM_NET_CLIENT_LIST], XA_WINDOW, 32, PropModeAppend,
+		                (unsigned char *)&client_list[client_list_pub], client_list_n - client_list_pub);
+	client_list_pub = client_list_n;
+	client_list_stale = False;
+
+	if (stack_dirty) {
+		XChangeProperty(dpy, root, atoms[ATOM_NET_CLIENT_LIST_STACKING], XA_WINDOW, 32, PropModeReplace,
+		                (unsigned char *)stack_pub, stack_pub_n);
+		stack_dirty = False;
+	}
 }
 
 void update_struts(void)
 {
+	PROBE1(struts_start, n_mons);
+
 	/* reset all reserves */
 	for (int i = 0; i < n_mons; i++) {
 		mons[i].reserve_left   = 0;
@@ -3068,8 +5379,12 @@ void update_struts(void)
 	Window *children = NULL;
 	unsigned int n_children = 0;
 
-	if (!XQueryTree(dpy, root, &root_ret, &parent_ret, &children, &n_children))
+	if (!XQueryTree(dpy, root, &root_ret, &parent_ret, &children, &n_children)) {
+		PROBE1(struts_done, 0);
 		return;
+	}
+	struts_stale = False;
+	n_docks = 0;
 
 	int screen_w = scr_width;
 	int screen_h = scr_height;
@@ -3098,6 +5413,11 @@ void update_struts(void)
 		if (!is_dock)
 			continue;
 
+		/* strut changes on the dock mark the struts stale */
+		select_input(w, PropertyChangeMask);
+		if (n_docks < MAX_DOCKS)
+			docks[n_docks++] = w;
+
 		long *str = NULL;
 		Atom actual;
 		int sfmt;
@@ -3219,6 +5539,7 @@ void update_struts(void)
 		XFree(children);
 
 	update_workarea();
+	PROBE1(struts_done, n_children);
 }
 
 void update_workarea(void)
@@ -3240,111 +5561,42 @@ void warp_cursor(Client *c)
 	if (!c)
 		return;
 
+	/* already inside, going by the last crossing or motion event */
+	int bw = user_config.border_width;
+	if (ptr_x >= c->x && ptr_x < c->x + c->w + 2 * bw && ptr_y >= c->y && ptr_y < c->y + c->h + 2 * bw)
+		return;
+
 	int center_x = c->x + (c->w / 2);
 	int center_y = c->y + (c->h / 2);
 
 	XWarpPointer(dpy, None, root, 0, 0, 0, 0, center_x, center_y);
-	XSync(dpy, False);
-}
-
-Bool window_has_ewmh_state(Window w, Atom state)
-{
-	Atom type;
-	int format;
-	unsigned long n_atoms = 0;
-	unsigned long unread = 0;
-	Atom *found_atoms = NULL;
-
-	if (XGetWindowProperty(dpy, w, atoms[ATOM_NET_WM_STATE], 0, 1024, False, XA_ATOM, &type,
-		&format, &n_atoms, &unread, (unsigned char**)&found_atoms) == Success && found_atoms) {
-
-		for (unsigned long i = 0; i < n_atoms; i++) {
-			if (found_atoms[i] == state) {
-				XFree(found_atoms);
-				return True;
-			}
-		}
-		XFree(found_atoms);
-	}
-	return False;
-}
-
-void window_set_ewmh_state(Window w, Atom state, Bool add)
-{
-	Atom type;
-	int format;
-	unsigned long n_atoms = 0;
-	unsigned long unread = 0;
-	Atom *found_atoms = NULL;
-
-	if (XGetWindowProperty(dpy, w, atoms[ATOM_NET_WM_STATE], 0, 1024, False, XA_ATOM, &type,
-		&format, &n_atoms, &unread, (unsigned char**)&found_atoms) != Success) {
-		found_atoms = NULL;
-		n_atoms = 0;
-	}
-
-	/* build new list */
-	Atom buf[16];
-	Atom *list = buf;
-	unsigned long list_len = 0;
-
-	if (found_atoms) {
-		for (unsigned long i = 0; i < n_atoms; i++) {
-			if (found_atoms[i] != state)
-				list[list_len++] = found_atoms[i];	
-		}
-	}
-	if (add && list_len < 16)
-		list[list_len++] = state;
-
-	if (list_len == 0)
-		XDeleteProperty(dpy, w, atoms[ATOM_NET_WM_STATE]);
-	else
-		XChangeProperty(dpy, w, atoms[ATOM_NET_WM_STATE], XA_ATOM, 32, PropModeReplace, (unsigned char*)list, list_len);
-
-	if (found_atoms)
-		XFree(found_atoms);	
+	ptr_x = center_x;
+	ptr_y = center_y;
 }
 
-Bool window_should_float(Window w)
+Bool window_should_float(XClassHint *ch)
 {
-	XClassHint ch = {0};
-	if (XGetClassHint(dpy, w, &ch)) {
-		for (int i = 0; i < MAX_ITEMS; i++) {
-			if (!user_config.should_float[i] || !user_config.should_float[i][0])
-				break;
+	for (int i = 0; i < MAX_ITEMS; i++) {
+		if (!user_config.should_float[i] || !user_config.should_float[i][0])
+			break;
 
-			if ((ch.res_class && !strcmp(ch.res_class, user_config.should_float[i][0])) ||
-			    (ch.res_name && !strcmp(ch.res_name, user_config.should_float[i][0]))) {
-				XFree(ch.res_class);
-				XFree(ch.res_name);
-				return True;
-			}
-		}
-		XFree(ch.res_class);
-		XFree(ch.res_name);
+		if ((ch->res_class && !strcmp(ch->res_class, user_config.should_float[i][0])) ||
+		    (ch->res_name && !strcmp(ch->res_name, user_config.should_float[i][0])))
+			return True;
 	}
 
 	return False;
 }
 
-Bool window_should_start_fullscreen(Window w)
+Bool window_should_start_fullscreen(XClassHint *ch)
 {
-	XClassHint ch = {0};
-	if (XGetClassHint(dpy, w, &ch)) {
-		for (int i = 0; i < MAX_ITEMS; i++) {
-			if (!user_config.start_fullscreen[i] || !user_config.start_fullscreen[i][0])
-				break;
+	for (int i = 0; i < MAX_ITEMS; i++) {
+		if (!user_config.start_fullscreen[i] || !user_config.start_fullscreen[i][0])
+			break;
 
-			if ((ch.res_class && !strcmp(ch.res_class, user_config.start_fullscreen[i][0])) ||
-			    (ch.res_name && !strcmp(ch.res_name, user_config.start_fullscreen[i][0]))) {
-				XFree(ch.res_class);
-				XFree(ch.res_name);
-				return True;
-			}
-		}
-		XFree(ch.res_class);
-		XFree(ch.res_name);
+		if ((ch->res_class && !strcmp(ch->res_class, user_config.start_fullscreen[i][0])) ||
+		    (ch->res_name && !strcmp(ch->res_name, user_config.start_fullscreen[i][0])))
+			return True;
 	}
 
 	return False;
@@ -3374,26 +5626,87 @@ int xerr(Display *d, XErrorEvent *ee)
 
 void xev_case(XEvent *xev)
 {
-	if (xev->type >= 0 && xev->type < LASTEvent)
-		evtable[xev->type](xev);
+	if (xev->type >= 0 && xev->type < LASTEvent) {
+		int type = xev->type;
+		unsigned long rt_before = stats.rt_calls[type];
+		unsigned long req_before = XNextRequest(dpy);
+		unsigned long long start = now_ns();
+
+		stats.events[type]++;
+		rt_event = type;
+		ring_begin(RING_EVENT, type, xev->xany.window, start);
+		stall_arm();
+		PROBE3(event_start, type, xev->xany.window, open_windows);
+		evtable[type](xev);
+		/* one restack for whatever the handler raised */
+		if (running)
+			restack();
+		stall_disarm();
+		rt_event = 0;
+		ring_push(RING_EVENT, type, xev->xany.window, start);
+		stall_check(event_names[type] ? event_names[type] : "event", xev->xany.window, start);
+		PROBE2(event_done, type, xev->xany.window);
+
+		/* the handler may have quit and closed the display */
+		if (running)
+			stats.requests[type] += XNextRequest(dpy) - req_before;
+		if (stats.rt_calls[type] - rt_before > stats.rt_max[type])
+			stats.rt_max[type] = stats.rt_calls[type] - rt_before;
+
+		if (user_config.handler_timing) {
+			unsigned long long took = now_ns() - start;
+
+			/* bucket b holds durations below 2^b microseconds, the last one the rest */
+			int b = 0;
+			for (unsigned long long us = took / 1000; us && b < HIST_BUCKETS - 1; us >>= 1)
+				b++;
+			stats.hist[type][b]++;
+			stats.hist_ns[type] += took;
+		}
+	}
 	else
 		fprintf(stderr, "sxwm: invalid event type: %d\n", xev->type);
 }
 
 int main(int ac, char **av)
 {
+	const char *record = NULL;
+	restart_argv = av;
+
 	if (ac > 1) {
 		if (strcmp(av[1], "-v") == 0 || strcmp(av[1], "--version") == 0) {
 			printf("%s\n%s\n%s\n", SXWM_VERSION, SXWM_AUTHOR, SXWM_LICINFO);
 			return EXIT_SUCCESS;
 		}
+		else if ((strcmp(av[1], "-m") == 0 || strcmp(av[1], "--msg") == 0) && ac > 2) {
+			return ipc_client(ac - 2, av + 2);
+		}
+		else if (strcmp(av[1], "--record") == 0 && ac > 2) {
+			record = av[2];
+		}
+		else if (strcmp(av[1], "--replay") == 0 && ac > 2) {
+			return trace_replay(av[2]);
+		}
+		else if (strcmp(av[1], "--ring-json") == 0 && ac > 2) {
+			return ring_json(av[2]);
+		}
+		else if (strcmp(av[1], "--trace-startup") == 0) {
+			startup_start = startup_last = now_ns();
+		}
 		else {
 			printf("usage:\n");
 			printf("\t[-v || --version]: See the version of sxwm\n");
+			printf("\t[-m || --msg] <request>: Query a running sxwm over its socket\n");
+			printf("\t[--record <file>]: Run and record every event to a trace file\n");
+			printf("\t[--replay <file>]: Feed a recorded trace through sxwm and print timings\n");
+			printf("\t[--ring-json <file>]: Convert a flight recorder dump to Chrome trace JSON\n");
+			printf("\t[--trace-startup]: Print how long each startup phase takes\n");
 			return EXIT_SUCCESS;
 		}
 	}
 	setup();
+	if (record)
+		trace_start(record);
 	puts("sxwm: starting...");
 	run();
 	return EXIT_SUCCESS;
@@ -0,0 +1,634 @@
+/*  See LICENSE for more info
+ *
+ *  bench: drives a running sxwm through fixed scenarios with stub
+ *  clients and prints one JSON object per scenario. Started by
+ *  tests/bench.sh under Xvfb, see `make bench`. `bench stamp <fifo>`
+ *  is the command the key_exec scenario binds to a key.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/keysym.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XTest.h>
+
+#define MAX_WINS     1024
+#define MAX_OPS      10000
+#define LOAD_WINS    20   /* clients around for the switch and reload scenarios */
+#define WAIT_MS      2000 /* give up on an operation after this long */
+#define SETTLE_MS    20
+#define BENCH_CLASS  "sxwm-bench"
+#define FLOAT_CLASS  "sxwm-bench-float" /* listed in should_float by bench.sh */
+#define ANY_CHANGE   (-1) /* wait for Map, Unmap or ConfigureNotify */
+
+typedef struct {
+	const char *name;
+	int (*run)(int n);
+} Scenario;
+
+int ipc_connect(void);
+char *ipc(const char *fmt, ...);
+unsigned long long now_ns(void);
+void settle(void);
+unsigned long stat_value(const char *stats, const char *name);
+void handle(XEvent *ev);
+Bool wait_for(Window w, int type, Atom atom);
+Window stub_client(int x, int y, const char *class);
+Bool map_client(Window w);
+void destroy_all(void);
+void pointer_to(int x, int y);
+void centre_of(Window w, int *x, int *y);
+void load_workspaces(void);
+void sleep_ms(int ms);
+int cmp_ull(const void *a, const void *b);
+int sc_destroy_storm(int n);
+int sc_drag_move(int n);
+int sc_drag_swap(int n);
+int sc_key_exec(int n);
+int sc_map_storm(int n);
+int sc_reload(int n);
+int sc_scratchpad(int n);
+int sc_switch_paint(int n);
+int sc_ws_switch(int n);
+
+Display *dpy;
+Window root;
+Atom a_client_list;
+Atom a_current_desktop;
+int ipc_fd = -1;
+Window wins[MAX_WINS];
+int n_wins = 0;
+int heads = 1;
+int head_w;
+unsigned long long lat[MAX_OPS];
+int n_lat = 0;
+int timeouts = 0;
+
+static const Scenario scenarios[] = {
+	{"map_storm",     sc_map_storm},
+	{"ws_switch",     sc_ws_switch},
+	{"switch_paint",  sc_switch_paint},
+	{"destroy_storm", sc_destroy_storm},
+	{"drag_move",     sc_drag_move},
+	{"drag_swap",     sc_drag_swap},
+	{"scratchpad",    sc_scratchpad},
+	{"reload",        sc_reload},
+	{"key_exec",      sc_key_exec},
+};
+
+int ipc_connect(void)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	const char *env = getenv("SXWM_SOCKET");
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	const char *display = getenv("DISPLAY");
+
+	/* same rules as runtime_path() in sxwm.c */
+	if (env && *env)
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", env);
+	else if (dir && *dir)
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/sxwm%s.sock", dir, display ? display : "");
+	else
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/sxwm-%u%s.sock",
+		         (unsigned)getuid(), display ? display : "");
+
+	/* sxwm may still be starting */
+	for (int i = 0; i < 100; i++) {
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+			return fd;
+		if (fd >= 0)
+			close(fd);
+		sleep_ms(50);
+	}
+	fprintf(stderr, "bench: cannot connect to %s\n", addr.sun_path);
+	return -1;
+}
+
+char *ipc(const char *fmt, ...)
+{
+	static char buf[32768];
+	char req[4096];
+	uint32_t len;
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(req, sizeof(req), fmt, ap);
+	va_end(ap);
+
+	len = strlen(req);
+	if (write(ipc_fd, &len, sizeof(len)) != sizeof(len) || write(ipc_fd, req, len) != (ssize_t)len) {
+		fprintf(stderr, "bench: ipc write failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* replies use the same framing */
+	size_t got = 0;
+	while (got < sizeof(len)) {
+		ssize_t r = read(ipc_fd, (char *)&len + got, sizeof(len) - got);
+		if (r <= 0 && !(r < 0 && errno == EINTR)) {
+			fprintf(stderr, "bench: sxwm went away\n");
+			exit(EXIT_FAILURE);
+		}
+		got += r > 0 ? r : 0;
+	}
+	if (len >= sizeof(buf)) {
+		fprintf(stderr, "bench: reply too long\n");
+		exit(EXIT_FAILURE);
+	}
+	for (got = 0; got < len;) {
+		ssize_t r = read(ipc_fd, buf + got, len - got);
+		if (r <= 0 && !(r < 0 && errno == EINTR)) {
+			fprintf(stderr, "bench: sxwm went away\n");
+			exit(EXIT_FAILURE);
+		}
+		got += r > 0 ? r : 0;
+	}
+	buf[len] = '\0';
+	return buf;
+}
+
+unsigned long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void settle(void)
+{
+	XEvent ev;
+
+	/* let sxwm finish whatever the last step started, untimed */
+	XSync(dpy, False);
+	sleep_ms(SETTLE_MS);
+	XSync(dpy, False);
+	while (XPending(dpy)) {
+		XNextEvent(dpy, &ev);
+		handle(&ev);
+	}
+}
+
+unsigned long stat_value(const char *stats, const char *name)
+{
+	size_t len = strlen(name);
+	for (const char *p = stats; p && *p; p = strchr(p, '\n'), p = p ? p + 1 : NULL)
+		if (strncmp(p, name, len) == 0 && p[len] == ' ')
+			return strtoul(p + len + 1, NULL, 10);
+	return 0;
+}
+
+void handle(XEvent *ev)
+{
+	/* stub clients paint on every expose like a real client would */
+	if (ev->type == Expose && ev->xexpose.count == 0)
+		XFillRectangle(dpy, ev->xexpose.window, DefaultGC(dpy, DefaultScreen(dpy)), 0, 0, 16, 16);
+}
+
+Bool wait_for(Window w, int type, Atom atom)
+{
+	unsigned long long deadline = now_ns() + WAIT_MS * 1000000ULL;
+	XEvent ev;
+
+	for (;;) {
+		while (XPending(dpy)) {
+			XNextEvent(dpy, &ev);
+			handle(&ev);
+			if (w != None && ev.xany.window != w)
+				continue;
+			if (type == ANY_CHANGE &&
+			    (ev.type == MapNotify || ev.type == UnmapNotify || ev.type == ConfigureNotify))
+				return True;
+			if (ev.type != type || (type == PropertyNotify && ev.xproperty.atom != atom))
+				continue;
+			return True;
+		}
+
+		unsigned long long t = now_ns();
+		if (t >= deadline) {
+			timeouts++;
+			return False;
+		}
+		struct pollfd pfd = {.fd = ConnectionNumber(dpy), .events = POLLIN};
+		poll(&pfd, 1, (int)((deadline - t) / 1000000) + 1);
+	}
+}
+
+Window stub_client(int x, int y, const char *class)
+{
+	if (n_wins >= MAX_WINS)
+		return None;
+
+	int scr = DefaultScreen(dpy);
+	Window w = XCreateSimpleWindow(dpy, root, x, y, 320, 240, 0,
+	                               BlackPixel(dpy, scr), WhitePixel(dpy, scr));
+	XClassHint ch = {.res_name = (char *)class, .res_class = (char *)class};
+	XSetClassHint(dpy, w, &ch);
+	XStoreName(dpy, w, class);
+	XSelectInput(dpy, w, StructureNotifyMask | ExposureMask);
+	wins[n_wins++] = w;
+	return w;
+}
+
+Bool map_client(Window w)
+{
+	XMapWindow(dpy, w);
+	XFlush(dpy);
+	return wait_for(w, MapNotify, None);
+}
+
+void destroy_all(void)
+{
+	for (int i = 0; i < n_wins; i++)
+		XDestroyWindow(dpy, wins[i]);
+	n_wins = 0;
+
+	/* wait for sxwm to drop them, then start the next scenario on workspace 1 */
+	unsigned long long deadline = now_ns() + WAIT_MS * 1000000ULL;
+	while (now_ns() < deadline) {
+		Atom type;
+		int format;
+		unsigned long n = 1, after;
+		unsigned char *data = NULL;
+
+		XSync(dpy, False);
+		if (XGetWindowProperty(dpy, root, a_client_list, 0, 1, False, XA_WINDOW, &type, &format,
+		                       &n, &after, &data) == Success && data)
+			XFree(data);
+		if (n == 0)
+			break;
+		sleep_ms(5);
+	}
+	ipc("batch workspace move 1");
+	settle();
+}
+
+void pointer_to(int x, int y)
+{
+	XTestFakeMotionEvent(dpy, -1, x, y, CurrentTime);
+	XFlush(dpy);
+}
+
+void centre_of(Window w, int *x, int *y)
+{
+	Window r;
+	int wx, wy;
+	unsigned int ww, wh, bw, depth;
+
+	XGetGeometry(dpy, w, &r, &wx, &wy, &ww, &wh, &bw, &depth);
+	*x = wx + (int)(ww / 2);
+	*y = wy + (int)(wh / 2);
+}
+
+void load_workspaces(void)
+{
+	for (int ws = 1; ws <= 2; ws++) {
+		ipc("batch workspace move %d", ws);
+		for (int i = 0; i < LOAD_WINS / 2; i++) {
+			pointer_to((i % heads) * head_w + 100, 100);
+			map_client(stub_client(0, 0, BENCH_CLASS));
+		}
+	}
+	settle();
+}
+
+void sleep_ms(int ms)
+{
+	struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L};
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+	return (x > y) - (x < y);
+}
+
+int sc_destroy_storm(int n)
+{
+	for (int i = 0; i < n && n_wins < MAX_WINS; i++) {
+		pointer_to((i % heads) * head_w + 100, 100);
+		map_client(stub_client(0, 0, BENCH_CLASS));
+	}
+	settle();
+	n = n_wins;
+
+	/* every client leaving rewrites _NET_CLIENT_LIST */
+	for (int i = n_wins - 1; i >= 0; i--) {
+		unsigned long long t = now_ns();
+		XDestroyWindow(dpy, wins[i]);
+		XFlush(dpy);
+		if (wait_for(root, PropertyNotify, a_client_list))
+			lat[n_lat++] = now_ns() - t;
+		n_wins--;
+	}
+	return n;
+}
+
+int sc_drag_move(int n)
+{
+	KeyCode super = XKeysymToKeycode(dpy, XK_Super_L);
+	Window w = stub_client(100, 100, FLOAT_CLASS);
+	int cx, cy;
+
+	pointer_to(head_w / 2, 300);
+	map_client(w);
+	settle();
+	centre_of(w, &cx, &cy);
+
+	pointer_to(cx, cy);
+	XTestFakeKeyEvent(dpy, super, True, CurrentTime);
+	XTestFakeButtonEvent(dpy, Button1, True, CurrentTime);
+	settle();
+
+	for (int i = 0; i < n; i++) {
+		/* motion_throttle is raised by bench.sh, stay above it all the same */
+		sleep_ms(2);
+		unsigned long long t = now_ns();
+		pointer_to(cx + 8 + 8 * (i & 1), cy);
+		if (wait_for(w, ConfigureNotify, None))
+			lat[n_lat++] = now_ns() - t;
+	}
+
+	XTestFakeButtonEvent(dpy, Button1, False, CurrentTime);
+	XTestFakeKeyEvent(dpy, super, False, CurrentTime);
+	settle();
+	return n;
+}
+
+int sc_drag_swap(int n)
+{
+	KeyCode super = XKeysymToKeycode(dpy, XK_Super_L);
+	KeyCode shift = XKeysymToKeycode(dpy, XK_Shift_L);
+	Window left, right;
+	int lx, ly, rx, ry;
+
+	pointer_to(100, 100);
+	left = stub_client(0, 0, BENCH_CLASS);
+	map_client(left);
+	right = stub_client(0, 0, BENCH_CLASS);
+	map_client(right);
+	settle();
+	centre_of(left, &lx, &ly);
+	centre_of(right, &rx, &ry);
+
+	for (int i = 0; i < n; i++) {
+		pointer_to(lx, ly);
+		XTestFakeKeyEvent(dpy, super, True, CurrentTime);
+		XTestFakeKeyEvent(dpy, shift, True, CurrentTime);
+		XTestFakeButtonEvent(dpy, Button1, True, CurrentTime);
+		settle();
+		pointer_to(rx, ry);
+		sleep_ms(2);
+		pointer_to(rx + 1, ry);
+		settle();
+
+		/* the swap happens on release, the dragged client moves to the right */
+		unsigned long long t = now_ns();
+		XTestFakeButtonEvent(dpy, Button1, False, CurrentTime);
+		XFlush(dpy);
+		if (wait_for(left, ConfigureNotify, None))
+			lat[n_lat++] = now_ns() - t;
+		XTestFakeKeyEvent(dpy, shift, False, CurrentTime);
+		XTestFakeKeyEvent(dpy, super, False, CurrentTime);
+		settle();
+
+		Window tmp = left;
+		left = right;
+		right = tmp;
+	}
+	return n;
+}
+
+int sc_key_exec(int n)
+{
+	KeyCode super = XKeysymToKeycode(dpy, XK_Super_L);
+	KeyCode key = XKeysymToKeycode(dpy, XK_F12);
+	const char *path = getenv("BENCH_STAMP");
+	int fd;
+
+	/* held open read-write so the stamp command never waits for a reader */
+	if (!path || (mkfifo(path, 0600) < 0 && errno != EEXIST) || (fd = open(path, O_RDWR)) < 0) {
+		fprintf(stderr, "bench: key_exec needs a BENCH_STAMP fifo\n");
+		return 0;
+	}
+
+	/* mod+F12 runs `bench stamp` with the time it started */
+	for (int i = 0; i < n; i++) {
+		unsigned long long stamp;
+		struct pollfd pfd = {.fd = fd, .events = POLLIN};
+
+		XTestFakeKeyEvent(dpy, super, True, CurrentTime);
+		XSync(dpy, False);
+		unsigned long long t = now_ns();
+		XTestFakeKeyEvent(dpy, key, True, CurrentTime);
+		XFlush(dpy);
+		if (poll(&pfd, 1, WAIT_MS) == 1 && read(fd, &stamp, sizeof(stamp)) == sizeof(stamp))
+			lat[n_lat++] = stamp - t;
+		else
+			timeouts++;
+		XTestFakeKeyEvent(dpy, key, False, CurrentTime);
+		XTestFakeKeyEvent(dpy, super, False, CurrentTime);
+		settle();
+	}
+	close(fd);
+	return n;
+}
+
+int sc_map_storm(int n)
+{
+	/* alternate heads so both monitors get laid out */
+	if (n > MAX_WINS)
+		n = MAX_WINS;
+	for (int i = 0; i < n; i++) {
+		pointer_to((i % heads) * head_w + 100, 100);
+		Window w = stub_client(0, 0, BENCH_CLASS);
+		unsigned long long t = now_ns();
+		if (map_client(w))
+			lat[n_lat++] = now_ns() - t;
+	}
+	return n;
+}
+
+int sc_reload(int n)
+{
+	for (int i = 0; i < LOAD_WINS; i++) {
+		pointer_to((i % heads) * head_w + 100, 100);
+		map_client(stub_client(0, 0, BENCH_CLASS));
+	}
+	settle();
+
+	/* the reply is sent once the reload and relayout are done */
+	for (int i = 0; i < n; i++) {
+		unsigned long long t = now_ns();
+		ipc("batch reload_config");
+		lat[n_lat++] = now_ns() - t;
+	}
+	settle();
+	return n;
+}
+
+int sc_scratchpad(int n)
+{
+	Window w = stub_client(0, 0, BENCH_CLASS);
+
+	pointer_to(100, 100);
+	map_client(w);
+	settle();
+	ipc("batch focus %lx; scratchpad create 1", w);
+	settle();
+
+	/* hidden scratchpads are unmapped or moved away, shown ones mapped and raised */
+	for (int i = 0; i < n; i++) {
+		unsigned long long t = now_ns();
+		ipc("batch scratchpad toggle 1");
+		if (wait_for(w, ANY_CHANGE, None))
+			lat[n_lat++] = now_ns() - t;
+		settle();
+	}
+	ipc("batch scratchpad remove 1");
+	return n;
+}
+
+int sc_switch_paint(int n)
+{
+	load_workspaces();
+
+	/* until a client of the new workspace is exposed and has drawn */
+	for (int i = 0; i < n; i++) {
+		unsigned long long t = now_ns();
+		ipc("batch workspace move %d", 1 + (i & 1));
+		if (wait_for(None, Expose, None)) {
+			XSync(dpy, False);
+			lat[n_lat++] = now_ns() - t;
+		}
+		settle();
+	}
+	return n;
+}
+
+int sc_ws_switch(int n)
+{
+	load_workspaces();
+
+	for (int i = 0; i < n; i++) {
+		unsigned long long t = now_ns();
+		ipc("batch workspace move %d", 1 + (i & 1));
+		if (wait_for(root, PropertyNotify, a_current_desktop))
+			lat[n_lat++] = now_ns() - t;
+	}
+	return n;
+}
+
+int main(int ac, char **av)
+{
+	const char *mode = "default";
+	int n = 100;
+	int i = 1;
+
+	/* key_exec: as early as possible once exec'd */
+	if (ac == 3 && strcmp(av[1], "stamp") == 0) {
+		unsigned long long t = now_ns();
+		int fd = open(av[2], O_WRONLY | O_NONBLOCK);
+		if (fd < 0 || write(fd, &t, sizeof(t)) != sizeof(t))
+			return EXIT_FAILURE;
+		close(fd);
+		return EXIT_SUCCESS;
+	}
+
+	for (; i < ac && av[i][0] == '-'; i++) {
+		if (strcmp(av[i], "-n") == 0 && i + 1 < ac)
+			n = atoi(av[++i]);
+		else if (strcmp(av[i], "-m") == 0 && i + 1 < ac)
+			mode = av[++i];
+		else
+			break;
+	}
+	if (n < 1 || n > MAX_OPS || i >= ac) {
+		fprintf(stderr, "usage: bench [-n ops] [-m mode] wait | scenario... | stamp fifo\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Xvfb takes a moment to come up */
+	for (int tries = 0; !(dpy = XOpenDisplay(NULL)) && tries < 100; tries++)
+		sleep_ms(50);
+	if (!dpy) {
+		fprintf(stderr, "bench: cannot open display\n");
+		return EXIT_FAILURE;
+	}
+	if (strcmp(av[i], "wait") == 0)
+		return EXIT_SUCCESS;
+
+	int ev, err, major, minor;
+	if (!XTestQueryExtension(dpy, &ev, &err, &major, &minor)) {
+		fprintf(stderr, "bench: server has no XTEST\n");
+		return EXIT_FAILURE;
+	}
+	if ((ipc_fd = ipc_connect()) < 0)
+		return EXIT_FAILURE;
+
+	root = DefaultRootWindow(dpy);
+	a_client_list = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+	a_current_desktop = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False);
+	XSelectInput(dpy, root, PropertyChangeMask);
+
+	/* heads side by side as Xvfb +xinerama lays them out */
+	heads = atoi(getenv("BENCH_HEADS") ? getenv("BENCH_HEADS") : "1");
+	if (heads < 1)
+		heads = 1;
+	head_w = DisplayWidth(dpy, DefaultScreen(dpy)) / heads;
+
+	for (; i < ac; i++) {
+		const Scenario *sc = NULL;
+		for (size_t j = 0; j < sizeof(scenarios) / sizeof(scenarios[0]); j++)
+			if (strcmp(av[i], scenarios[j].name) == 0)
+				sc = &scenarios[j];
+		if (!sc) {
+			fprintf(stderr, "bench: unknown scenario '%s'\n", av[i]);
+			return EXIT_FAILURE;
+		}
+
+		char *s = ipc("stats");
+		unsigned long req0 = stat_value(s, "sxwm_x_requests_total");
+		unsigned long rt0 = stat_value(s, "sxwm_round_trips_total");
+		n_lat = 0;
+		timeouts = 0;
+
+		int ops = sc->run(n);
+
+		s = ipc("stats");
+		unsigned long req = stat_value(s, "sxwm_x_requests_total") - req0;
+		unsigned long rt = stat_value(s, "sxwm_round_trips_total") - rt0;
+		destroy_all();
+
+		qsort(lat, n_lat, sizeof(lat[0]), cmp_ull);
+		unsigned long long p50 = n_lat ? lat[(n_lat - 1) * 50 / 100] : 0;
+		unsigned long long p99 = n_lat ? lat[(n_lat - 1) * 99 / 100] : 0;
+		unsigned long long max = n_lat ? lat[n_lat - 1] : 0;
+		printf("{\"scenario\":\"%s\",\"mode\":\"%s\",\"ops\":%d,\"timeouts\":%d,"
+		       "\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f,"
+		       "\"x_requests\":%lu,\"x_requests_per_op\":%.1f,\"round_trips\":%lu}\n",
+		       sc->name, mode, ops, timeouts, p50 / 1e3, p99 / 1e3, max / 1e3,
+		       req, ops ? (double)req / ops : 0.0, rt);
+		fflush(stdout);
+	}
+
+	close(ipc_fd);
+	XCloseDisplay(dpy);
+	return EXIT_SUCCESS;
+}
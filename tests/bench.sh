@@ -0,0 +1,72 @@
+#!/bin/sh
+# make bench: runs sxwm on a two head Xvfb and drives it through the
+# scenarios in tests/bench.c, once per hiding mode. Prints a JSON array
+# with p50/p99 latencies and X request counts per scenario and mode.
+#
+# usage: tests/bench.sh [ops per scenario]
+
+ops=${1:-100}
+dpy=${BENCH_DISPLAY:-:99}
+scenarios=${BENCH_SCENARIOS:-"map_storm ws_switch switch_paint destroy_storm drag_move drag_swap scratchpad reload key_exec"}
+bench=$(pwd)/build/bench
+sxwm=./sxwm
+
+command -v Xvfb >/dev/null 2>&1 || { echo "bench: Xvfb not found" >&2; exit 1; }
+[ -x "$bench" ] && [ -x "$sxwm" ] || { echo "bench: run make bench" >&2; exit 1; }
+
+tmp=$(mktemp -d) || exit 1
+xvfb_pid=
+wm_pid=
+cleanup() {
+	[ -n "$wm_pid" ] && kill "$wm_pid" 2>/dev/null
+	[ -n "$xvfb_pid" ] && kill "$xvfb_pid" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$tmp"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+# two 1280x1024 heads side by side, seen by sxwm as Xinerama screens
+Xvfb "$dpy" -screen 0 1280x1024x24 -screen 1 1280x1024x24 +xinerama -nolisten tcp \
+	>"$tmp/xvfb.log" 2>&1 &
+xvfb_pid=$!
+
+export DISPLAY="$dpy"
+export XDG_CONFIG_HOME="$tmp"
+export XDG_RUNTIME_DIR="$tmp"
+export BENCH_HEADS=2
+export BENCH_STAMP="$tmp/stamp"
+unset SXWM_SOCKET
+
+"$bench" wait || { cat "$tmp/xvfb.log" >&2; exit 1; }
+
+first=1
+echo "["
+for hide in false true; do
+	if [ "$hide" = true ]; then mode=offscreen; else mode=unmap; fi
+	cat >"$tmp/sxwmrc" <<EOF
+hide_offscreen  : $hide
+motion_throttle : 1000
+new_win_focus   : true
+warp_cursor     : false
+should_float    : "sxwm-bench-float"
+mod_key         : super
+bind : mod + F12 : "$bench stamp $BENCH_STAMP"
+EOF
+
+	"$sxwm" >"$tmp/sxwm-$mode.log" 2>&1 &
+	wm_pid=$!
+
+	for sc in $scenarios; do
+		out=$("$bench" -n "$ops" -m "$mode" "$sc") || { cat "$tmp/sxwm-$mode.log" >&2; exit 1; }
+		[ "$first" = 1 ] || echo ","
+		first=0
+		printf '%s' "$out"
+	done
+
+	kill "$wm_pid"
+	wait "$wm_pid" 2>/dev/null
+	wm_pid=
+done
+echo
+echo "]"
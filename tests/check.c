@@ -0,0 +1,623 @@
+/*  See LICENSE for more info
+ *
+ *  check: runs sxwm's handlers against tests/xstub.c, no X server
+ *  needed, and holds them to request budgets. `check -b` times the
+ *  same paths as microbenchmarks instead. See `make check`.
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/keysym.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+
+#include "../src/defs.h"
+#include "../src/extern.h"
+#include "xstub.h"
+
+/* -Dmain=sxwm_main is for sxwm.c, this is the real one */
+#undef main
+
+#define HEAD_W 1280
+#define HEAD_H 1024
+
+/* budgets are what a path has to send, not what it sent when the check was written */
+
+/* old and new focus border, XSetInputFocus, _NET_ACTIVE_WINDOW */
+#define FOCUS_REQUESTS 4
+/* the only round trips of a client's life, one per piece of state the rules and layout need:
+ * attributes, _NET_WM_WINDOW_TYPE, WM_CLASS, _NET_WM_STATE, _NET_WM_PID, WM_TRANSIENT_FOR,
+ * WM_NORMAL_HINTS and the pointer for its monitor; later paths work from what they cached */
+#define MAP_READS 8
+/* XSelectInput, four button grabs, WM_PROTOCOLS */
+#define MAP_INPUT 6
+/* _NET_WM_DESKTOP, WM_STATE, _NET_CLIENT_LIST, _NET_FRAME_EXTENTS */
+#define MAP_PROPERTIES 4
+/* XGrabServer, XUngrabServer and the XSync that ends the switch, its one round trip */
+#define SWITCH_GRAB 3
+/* per client hidden or shown: unmap or map, WM_STATE, _NET_WM_STATE */
+#define SWITCH_PER_CLIENT 3
+
+/* sxwm.c, built with -Dmain=sxwm_main */
+extern Display *dpy;
+extern Window root;
+extern Client *workspaces[NUM_WORKSPACES];
+extern Client *focused;
+extern Config user_config;
+extern int current_ws;
+extern int ptr_x, ptr_y;
+extern volatile sig_atomic_t ring_depth;
+extern int stall_armed;
+extern char ring_path[];
+extern Client *stack_list[];
+extern int stack_n;
+void apply_fullscreen(Client *c, Bool on);
+void change_workspace(int ws);
+Client *find_client(Window w);
+void ipc_cleanup(void);
+void raise_client(Client *c);
+void restack(void);
+Bool restart_restore(const char *path);
+Bool restart_save(const char *path);
+void setup(void);
+void snapshot_cleanup(void);
+void tile(void);
+void tile_idle(void);
+void update_net_client_list(void);
+void warp_cursor(Client *c);
+void xev_case(XEvent *xev);
+
+typedef struct {
+	const char *name;
+	void (*setup)(void);
+	void (*run)(int i);
+} Bench;
+
+static void budget(const char *what, unsigned long max_requests, unsigned long max_round_trips);
+static int capture_begin(int fds[2]);
+static void capture_end(int fds[2], int saved, char *out, size_t size);
+static void expect(Bool ok, const char *what);
+static void settle(void);
+static Window map_client(const char *class, int x, int y);
+static void destroy_client(Window w);
+static void unmap_all(void);
+static void key(KeySym ks);
+static void enter(Client *c);
+static void write_config(const char *path);
+static unsigned long long now_ns(void);
+static void test_adopt(Window client, Window dock, const char *err);
+static void test_budgets(void);
+static void test_hidden_fullscreen(void);
+static void test_no_round_trips(void);
+static void test_restart(void);
+static void test_state_echoes(void);
+static void test_stall(void);
+static void bench(int iterations);
+static void bench_clients(void);
+static void run_focus(int i);
+static void run_map_destroy(int i);
+static void run_tile_clean(int i);
+static void run_tile_resize(int i);
+static void run_ws_switch(int i);
+
+static int failures = 0;
+static Atom a_state;
+static Atom a_fullscreen;
+static char dir[] = "/tmp/sxwm-check-XXXXXX";
+
+static const Bench benches[] = {
+	{"tile_clean",  bench_clients, run_tile_clean},
+	{"tile_resize", bench_clients, run_tile_resize},
+	{"focus_next",  bench_clients, run_focus},
+	{"ws_switch",   bench_clients, run_ws_switch},
+	{"map_destroy", NULL,          run_map_destroy},
+};
+
+static void budget(const char *what, unsigned long max_requests, unsigned long max_round_trips)
+{
+	Bool ok = stub_requests <= max_requests && stub_round_trips <= max_round_trips;
+	printf("%s %-44s %3lu requests (max %lu), %lu round trips (max %lu)\n", ok ? "ok  " : "FAIL",
+	       what, stub_requests, max_requests, stub_round_trips, max_round_trips);
+	if (!ok) {
+		stub_report(stdout);
+		failures++;
+	}
+}
+
+static int capture_begin(int fds[2])
+{
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+	int saved = dup(STDERR_FILENO);
+	dup2(fds[1], STDERR_FILENO);
+	return saved;
+}
+
+static void capture_end(int fds[2], int saved, char *out, size_t size)
+{
+	dup2(saved, STDERR_FILENO);
+	close(saved);
+	close(fds[1]);
+	ssize_t n = read(fds[0], out, size - 1);
+	close(fds[0]);
+	out[n > 0 ? n : 0] = '\0';
+}
+
+static void expect(Bool ok, const char *what)
+{
+	printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok)
+		failures++;
+}
+
+static void settle(void)
+{
+	XEvent ev;
+
+	/* what run() does between events: echoes, idle layout, stacking, lists */
+	while (XPending(dpy)) {
+		XNextEvent(dpy, &ev);
+		xev_case(&ev);
+	}
+	tile_idle();
+	restack();
+	update_net_client_list();
+}
+
+static Window map_client(const char *class, int x, int y)
+{
+	Window w = stub_window(x, y, 400, 300);
+	stub_set_class(w, class, class);
+
+	/* new clients go to the monitor under the pointer */
+	stub_pointer(x, y);
+	XEvent ev = {.xmaprequest = {.type = MapRequest, .parent = root, .window = w}};
+	xev_case(&ev);
+	return w;
+}
+
+static void destroy_client(Window w)
+{
+	stub_destroy(w);
+	XEvent ev = {.xdestroywindow = {.type = DestroyNotify, .event = root, .window = w}};
+	xev_case(&ev);
+}
+
+static void unmap_all(void)
+{
+	for (int ws = 0; ws < NUM_WORKSPACES; ws++)
+		while (workspaces[ws])
+			destroy_client(workspaces[ws]->win);
+	change_workspace(0);
+	settle();
+}
+
+static void key(KeySym ks)
+{
+	XEvent ev = {.xkey = {.type = KeyPress, .window = root, .root = root,
+	                      .state = user_config.modkey, .keycode = XKeysymToKeycode(dpy, ks)}};
+	xev_case(&ev);
+}
+
+static void enter(Client *c)
+{
+	XEvent ev = {.xcrossing = {.type = EnterNotify, .window = c->win, .root = root,
+	                           .x_root = c->x + c->w / 2, .y_root = c->y + c->h / 2}};
+	xev_case(&ev);
+}
+
+static void write_config(const char *path)
+{
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	/* warping is checked on its own, see test_no_round_trips */
+	/* the stall budget is for adoption, main drops it once setup is done */
+	fputs("new_win_focus : true\n"
+	      "stall_budget  : 20\n"
+	      "warp_cursor   : false\n"
+	      "should_float  : \"float\"\n"
+	      "mod_key       : super\n"
+	      "call : mod + j : focus_next\n"
+	      "call : mod + f : fullscreen\n"
+	      "call : mod + period : focus_next_mon\n", f);
+	fclose(f);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void test_adopt(Window client, Window dock, const char *err)
+{
+	/* SIGALRM with its default action would have killed us before this */
+	expect(strstr(err, "stall: tile") != NULL, "stall during adoption is reported, not fatal");
+
+	/* the dock is above the client, adopting it must not take the focus */
+	expect(stub_focus() == client, "startup focuses the last adopted client, not a dock");
+	expect(find_client(dock) == NULL, "dock is not managed");
+
+	destroy_client(client);
+	destroy_client(dock);
+	settle();
+}
+
+static void test_budgets(void)
+{
+	Window a = map_client("a", 100, 100);
+	settle();
+	map_client("b", 100, 100);
+	settle();
+
+	/* b and c now share the stack: two configures, XMapWindow, XRaiseWindow, then the focus */
+	stub_reset();
+	map_client("c", 100, 100);
+	budget("map a tiled client", MAP_READS + MAP_INPUT + MAP_PROPERTIES + 2 + 2 + FOCUS_REQUESTS, MAP_READS);
+	settle();
+
+	stub_reset();
+	key(XK_j);
+	budget("focus change", FOCUS_REQUESTS, 0);
+	expect(stub_focus() == focused->win, "focus change sets input focus");
+	settle();
+
+	/* every client is where the layout wants it */
+	stub_reset();
+	tile();
+	budget("tile with nothing changed", 0, 0);
+
+	/* refused, the layout owns the geometry; at most the synthetic ConfigureNotify of ICCCM 4.1.5 */
+
+	stub_reset();
+	XEvent cfg = {.xconfigurerequest = {.type = ConfigureRequest, .parent = root, .window = a,
+	                                    .x = 5, .y = 5, .width = 50, .height = 50,
+	                                    .value_mask = CWX | CWY | CWWidth | CWHeight}};
+	xev_case(&cfg);
+	budget("configure request of a tiled client", 1, 0);
+	settle();
+
+	/* plus XSetInputFocus, _NET_ACTIVE_WINDOW and _NET_CURRENT_DESKTOP, whose echo costs nothing;
+	 * hidden clients keep their border colour, so showing them repaints none */
+	stub_reset();
+	change_workspace(1);
+	settle();
+	budget("switch to an empty workspace", SWITCH_GRAB + 3 * SWITCH_PER_CLIENT + 3, 1);
+	stub_reset();
+	change_workspace(0);
+	settle();
+	budget("switch back to three clients", SWITCH_GRAB + 3 * SWITCH_PER_CLIENT + 3, 1);
+
+	/* the other two are laid out again and published, the focus moves without an old border */
+	stub_reset();
+	destroy_client(a);
+	budget("destroy a tiled client", 2 + 2 + FOCUS_REQUESTS - 1, 0);
+	expect(!find_client(a), "destroyed client is dropped");
+	expect(ring_depth == 0, "every flight recorder span is closed");
+
+	unmap_all();
+}
+
+static void test_hidden_fullscreen(void)
+{
+	Window w = map_client("a", 100, 100);
+	settle();
+	Client *c = find_client(w);
+	key(XK_f);
+	settle();
+
+	/* hidden off-screen, the client asks for a smaller window at the origin */
+	user_config.hide_offscreen = True;
+	change_workspace(1);
+	settle();
+	XEvent cfg = {.xconfigurerequest = {.type = ConfigureRequest, .parent = root, .window = w,
+	                                    .x = 0, .y = 0, .width = 50, .height = 50,
+	                                    .value_mask = CWX | CWY | CWWidth | CWHeight}};
+	xev_case(&cfg);
+	settle();
+	change_workspace(0);
+	settle();
+	user_config.hide_offscreen = False;
+
+	expect(c->fullscreen && c->x == 0 && c->y == 0 && c->w == HEAD_W && c->h == HEAD_H,
+	       "hidden fullscreen client comes back at monitor size");
+
+	unmap_all();
+}
+
+static void test_no_round_trips(void)
+{
+	/* two clients on the first head, one on the second */
+	map_client("a", 100, 100);
+	settle();
+	map_client("b", 100, 100);
+	settle();
+	Window w = map_client("c", HEAD_W + 100, 100);
+	settle();
+
+	/* every client has been focused once */
+	key(XK_period);
+	settle();
+	key(XK_j);
+	settle();
+
+	stub_reset();
+	key(XK_j);
+	budget("focus change after first focus", FOCUS_REQUESTS, 0);
+	settle();
+
+	enter(focused);
+	settle();
+	stub_reset();
+	warp_cursor(focused);
+	budget("warp with the pointer already inside", 0, 0);
+
+	stub_reset();
+	focus_next_mon();
+	budget("focus_next_mon", FOCUS_REQUESTS, 0);
+	expect(focused && focused->win == w, "focus_next_mon focuses the other head");
+	settle();
+
+	/* one configure for geometry and border, one _NET_WM_STATE write */
+	Client *c = focused;
+	stub_reset();
+	apply_fullscreen(c, True);
+	budget("apply_fullscreen on", 2, 0);
+	settle();
+	stub_reset();
+	apply_fullscreen(c, False);
+	budget("apply_fullscreen off", 2, 0);
+	settle();
+
+	unmap_all();
+}
+
+static void test_restart(void)
+{
+	char path[sizeof(dir) + 16];
+	Window w[3];
+
+	for (int i = 0; i < 3; i++) {
+		w[i] = map_client("a", 100, 100);
+		settle();
+	}
+	/* raised, so the stack order is no longer the list order */
+	raise_client(find_client(w[0]));
+	settle();
+
+	snprintf(path, sizeof(path), "%s/restart", dir);
+	expect(restart_save(path), "restart state written");
+
+	/* what the exec'd image starts from: the windows, but no clients */
+	for (int i = 0; i < 3; i++) {
+		XEvent ev = {.xdestroywindow = {.type = DestroyNotify, .event = root, .window = w[i]}};
+		xev_case(&ev);
+	}
+	settle();
+	expect(restart_restore(path), "restart state restored");
+	settle();
+
+	expect(stack_n == 3 && stack_list[0]->win == w[1] && stack_list[1]->win == w[2] &&
+	       stack_list[2]->win == w[0], "stack order survives a restart");
+
+	unmap_all();
+}
+
+static void test_state_echoes(void)
+{
+	Window w = map_client("a", 100, 100);
+	settle();
+	Client *c = find_client(w);
+
+	/* sxwm's own _NET_WM_STATE writes come back once each and are skipped */
+	key(XK_f);
+	settle();
+	expect(c->fullscreen && c->state_echoes == 0, "fullscreen on, echo consumed");
+	key(XK_f);
+	settle();
+	expect(!c->fullscreen && c->state_echoes == 0, "fullscreen off, echo consumed");
+	expect(!stub_has_property(w, a_state), "last state removed deletes the property");
+
+	/* hidden and shown again, still nothing left over */
+	change_workspace(1);
+	settle();
+	change_workspace(0);
+	settle();
+	expect(c->state_echoes == 0, "hide and show, echoes consumed");
+
+	/* the client drops the property behind sxwm's back */
+	key(XK_f);
+	settle();
+	stub_delete_property(w, a_state);
+	settle();
+	expect(!c->fullscreen && !c->state_set, "client removing the property leaves fullscreen");
+
+	/* sxwm removes a state the client already deleted, before it hears of it */
+	key(XK_f);
+	settle();
+	stub_delete_property(w, a_state);
+	key(XK_f);
+	settle();
+	expect(!c->fullscreen && c->state_echoes == 0, "racing deletes leave no echo pending");
+
+	/* a change from the client after all that is still seen */
+	stub_set_property(w, a_state, XA_ATOM, 32, &a_fullscreen, 1);
+	settle();
+	expect(c->fullscreen && c->state_set, "client request after echoes is applied");
+
+	unmap_all();
+}
+
+static void test_stall(void)
+{
+	char out[1024];
+	int fds[2];
+
+	map_client("a", 100, 100);
+	settle();
+	int saved = capture_begin(fds);
+
+	/* a pager switches workspace and the XSync of the switch hangs for three budgets */
+	XEvent ev = {.xclient = {.type = ClientMessage, .window = root, .format = 32,
+	                         .message_type = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False),
+	                         .data.l = {1}}};
+	user_config.stall_budget = 20;
+	stub_delay("XSync", 60);
+	xev_case(&ev);
+	stub_delay(NULL, 0);
+	user_config.stall_budget = 0;
+	capture_end(fds, saved, out, sizeof(out));
+	char want[128];
+	snprintf(want, sizeof(want), "stall: ClientMessage (window 0x%lx) still running after", root);
+	expect(strstr(out, want) && strstr(out, " in server grab"),
+	       "stuck handler is reported while it is stuck");
+	expect(strstr(out, ring_path) != NULL, "flight recorder written from the timer signal");
+	expect(stall_armed == 0, "stall timer disarmed");
+
+	unmap_all();
+}
+
+static void bench_clients(void)
+{
+	for (int ws = 0; ws < 2; ws++) {
+		change_workspace(ws);
+		for (int i = 0; i < 10; i++)
+			map_client("bench", (i % 2) * HEAD_W + 100, 100);
+		settle();
+	}
+	change_workspace(0);
+	settle();
+}
+
+static void run_focus(int i)
+{
+	(void)i;
+	key(XK_j);
+}
+
+static void run_map_destroy(int i)
+{
+	(void)i;
+	destroy_client(map_client("bench", 100, 100));
+}
+
+static void run_tile_clean(int i)
+{
+	(void)i;
+	tile();
+}
+
+static void run_tile_resize(int i)
+{
+	if (i & 1)
+		resize_master_sub();
+	else
+		resize_master_add();
+}
+
+static void run_ws_switch(int i)
+{
+	change_workspace(!(i & 1));
+}
+
+static void bench(int iterations)
+{
+	for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+		if (benches[b].setup)
+			benches[b].setup();
+
+		stub_reset();
+		unsigned long long t = now_ns();
+		for (int i = 0; i < iterations; i++) {
+			benches[b].run(i);
+			settle();
+		}
+		t = now_ns() - t;
+
+		printf("{\"bench\":\"%s\",\"iterations\":%d,\"ns_per_op\":%.0f,"
+		       "\"requests_per_op\":%.1f,\"round_trips_per_op\":%.2f}\n",
+		       benches[b].name, iterations, (double)t / iterations,
+		       (double)stub_requests / iterations, (double)stub_round_trips / iterations);
+		unmap_all();
+	}
+}
+
+int main(int ac, char **av)
+{
+	char path[sizeof(dir) + 16];
+	char err[1024];
+	int fds[2];
+	int iterations = 0;
+
+	if (ac > 1 && strcmp(av[1], "-b") == 0)
+		iterations = ac > 2 ? atoi(av[2]) : 10000;
+
+	/* config, ipc socket and state file all go to a scratch directory */
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+	snprintf(path, sizeof(path), "%s/sxwmrc", dir);
+	write_config(path);
+	setenv("HOME", dir, 1);
+	setenv("XDG_CONFIG_HOME", dir, 1);
+	setenv("XDG_RUNTIME_DIR", dir, 1);
+	setenv("DISPLAY", ":check", 1);
+	unsetenv("SXWM_SOCKET");
+	unsetenv("SXWM_RESTART");
+
+	/* left mapped by a previous wm: a client, and a dock stacked above it */
+	stub_heads(2, HEAD_W, HEAD_H);
+	Window old_client = stub_window(100, 100, 400, 300);
+	stub_set_class(old_client, "old", "old");
+	stub_map(old_client);
+	Window old_dock = stub_window(0, 0, HEAD_W, 20);
+	Atom dock_type = XInternAtom(NULL, "_NET_WM_WINDOW_TYPE_DOCK", False);
+	stub_set_property(old_dock, XInternAtom(NULL, "_NET_WM_WINDOW_TYPE", False), XA_ATOM, 32, &dock_type, 1);
+	stub_map(old_dock);
+
+	/* a slow server while the old windows are adopted blows the stall budget */
+	stub_delay("XQueryTree", 60);
+	int saved = capture_begin(fds);
+	setup();
+	capture_end(fds, saved, err, sizeof(err));
+	stub_delay(NULL, 0);
+	user_config.stall_budget = 0;
+	a_state = XInternAtom(dpy, "_NET_WM_STATE", False);
+	a_fullscreen = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
+	settle();
+
+	if (iterations > 0) {
+		bench(iterations);
+	}
+	else {
+		test_adopt(old_client, old_dock, err);
+		test_budgets();
+		test_hidden_fullscreen();
+		test_no_round_trips();
+		test_restart();
+		test_state_echoes();
+		test_stall();
+	}
+
+	ipc_cleanup();
+	snapshot_cleanup();
+	unlink(path);
+	unlink(ring_path);
+	rmdir(dir);
+
+	if (failures)
+		printf("%d check%s failed\n", failures, failures == 1 ? "" : "s");
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,1149 @@
+/*  See LICENSE for more info
+ *
+ *  xstub: the Xlib, Xinerama and Xcursor calls sxwm makes, answered
+ *  from an in-process model of the server. Every call that would send
+ *  a request is counted, and the ones that wait for a reply are counted
+ *  again as round trips, so tests can hold handlers to a budget without
+ *  an X server. Properties are kept per window and returned as scripted
+ *  by the test. The only events generated are the PropertyNotify echoes
+ *  of sxwm's own writes; tests hand every other event to xev_case.
+*/
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/keysym.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/Xinerama.h>
+#include <X11/Xcursor/Xcursor.h>
+
+#include "xstub.h"
+
+#define STUB_WINS    512
+#define STUB_PROPS   32
+#define STUB_ATOMS   256
+#define STUB_EVENTS  1024
+#define STUB_HEADS   8
+#define STUB_CALLS   64
+#define STUB_ROOT    0x100
+#define STUB_FIRST   0x200000 /* first id handed out to windows */
+
+typedef struct {
+	Atom name;
+	Atom type;
+	int format;
+	unsigned long n;    /* items */
+	unsigned char *data; /* format 32 items are stored as long, like Xlib hands them out */
+} StubProp;
+
+typedef struct {
+	Window id;
+	int x, y, w, h, bw;
+	Bool mapped;
+	Bool override_redirect;
+	long mask; /* what sxwm selected */
+	StubProp props[STUB_PROPS];
+	int n_props;
+} StubWin;
+
+typedef struct {
+	const char *name;
+	unsigned long n;
+	Bool blocking;
+} StubCall;
+
+unsigned long stub_requests = 0;
+unsigned long stub_round_trips = 0;
+
+static unsigned long serial = 0; /* never reset, XNextRequest deltas stay valid */
+static _XPrivDisplay disp = NULL;
+static StubWin wins[STUB_WINS] = {{.id = STUB_ROOT, .mapped = True}}; /* wins[0] is the root */
+static int n_wins = 0;
+static Window stack[STUB_WINS]; /* children of the root, bottom to top */
+static int n_stack = 0;
+static Window next_id = STUB_FIRST;
+static char *atom_names[STUB_ATOMS];
+static int n_atoms = 0;
+static XEvent queue[STUB_EVENTS];
+static int q_head = 0, q_len = 0;
+static XineramaScreenInfo heads[STUB_HEADS];
+static int n_heads = 1;
+static int ptr_x = 0, ptr_y = 0;
+static Window focus = PointerRoot;
+static Cursor next_cursor = 1;
+static StubCall calls[STUB_CALLS];
+static int n_calls = 0;
+static const char *delay_call = NULL; /* NULL: the next round trip */
+static int delay_ms = 0;
+
+static void req(const char *name, Bool blocking)
+{
+	serial++;
+	stub_requests++;
+	if (blocking)
+		stub_round_trips++;
+
+	/* a slow server, signals must not cut the wait short */
+	if (blocking && delay_ms && (!delay_call || strcmp(delay_call, name) == 0)) {
+		struct timespec until;
+		clock_gettime(CLOCK_MONOTONIC, &until);
+		until.tv_sec += delay_ms / 1000;
+		until.tv_nsec += delay_ms % 1000 * 1000000L;
+		if (until.tv_nsec >= 1000000000L) {
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000L;
+		}
+		if (!delay_call)
+			delay_ms = 0;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) != 0)
+			;
+	}
+
+	/* names are literals, one per function */
+	for (int i = 0; i < n_calls; i++) {
+		if (calls[i].name == name) {
+			calls[i].n++;
+			return;
+		}
+	}
+	if (n_calls < STUB_CALLS)
+		calls[n_calls++] = (StubCall){name, 1, blocking};
+}
+
+static StubWin *win(Window id)
+{
+	for (int i = 0; i < n_wins; i++)
+		if (wins[i].id == id)
+			return &wins[i];
+	return NULL;
+}
+
+static StubProp *prop(StubWin *sw, Atom name)
+{
+	for (int i = 0; sw && i < sw->n_props; i++)
+		if (sw->props[i].name == name)
+			return &sw->props[i];
+	return NULL;
+}
+
+static size_t unit(int format)
+{
+	return format == 32 ? sizeof(long) : (size_t)format / 8;
+}
+
+static Atom intern(const char *name, Bool only_if_exists)
+{
+	for (int i = 0; i < n_atoms; i++)
+		if (strcmp(atom_names[i], name) == 0)
+			return XA_LAST_PREDEFINED + 1 + i;
+	if (only_if_exists || n_atoms == STUB_ATOMS)
+		return None;
+	atom_names[n_atoms] = strdup(name);
+	return XA_LAST_PREDEFINED + 1 + n_atoms++;
+}
+
+static void notify(StubWin *sw, Atom name, int state)
+{
+	if (!(sw->mask & PropertyChangeMask))
+		return;
+	if (q_len == STUB_EVENTS) {
+		fprintf(stderr, "xstub: event queue full\n");
+		return;
+	}
+
+	XEvent *ev = &queue[(q_head + q_len++) % STUB_EVENTS];
+	memset(ev, 0, sizeof(*ev));
+	ev->xproperty.type = PropertyNotify;
+	ev->xproperty.display = (Display *)disp;
+	ev->xproperty.window = sw->id;
+	ev->xproperty.atom = name;
+	ev->xproperty.state = state;
+}
+
+static void set_prop(StubWin *sw, Atom name, Atom type, int format, int mode,
+                     const unsigned char *data, int n)
+{
+	StubProp *p = prop(sw, name);
+	if (!p) {
+		if (sw->n_props == STUB_PROPS) {
+			fprintf(stderr, "xstub: too many properties on 0x%lx\n", sw->id);
+			return;
+		}
+		p = &sw->props[sw->n_props++];
+		*p = (StubProp){.name = name};
+		mode = PropModeReplace;
+	}
+	if (mode != PropModeReplace && (p->type != type || p->format != format))
+		mode = PropModeReplace;
+
+	size_t u = unit(format);
+	unsigned long old = mode == PropModeReplace ? 0 : p->n;
+	unsigned char *buf = calloc(old + n + 1, u);
+	if (!buf)
+		return;
+	if (mode == PropModeAppend) {
+		memcpy(buf, p->data, old * u);
+		memcpy(buf + old * u, data, n * u);
+	}
+	else if (mode == PropModePrepend) {
+		memcpy(buf, data, n * u);
+		memcpy(buf + n * u, p->data, old * u);
+	}
+	else {
+		memcpy(buf, data, n * u);
+	}
+	free(p->data);
+	p->data = buf;
+	p->n = old + n;
+	p->type = type;
+	p->format = format;
+	notify(sw, name, PropertyNewValue);
+}
+
+static Bool del_prop(StubWin *sw, Atom name)
+{
+	StubProp *p = prop(sw, name);
+	if (!p)
+		return False;
+
+	/* the server only reports deleting a property that exists */
+	free(p->data);
+	*p = sw->props[--sw->n_props];
+	notify(sw, name, PropertyDelete);
+	return True;
+}
+
+static void unstack(Window w)
+{
+	for (int i = 0; i < n_stack; i++) {
+		if (stack[i] == w) {
+			memmove(&stack[i], &stack[i + 1], (n_stack - i - 1) * sizeof(Window));
+			n_stack--;
+			return;
+		}
+	}
+}
+
+static void restack_at(Window w, int pos)
+{
+	unstack(w);
+	if (pos > n_stack)
+		pos = n_stack;
+	memmove(&stack[pos + 1], &stack[pos], (n_stack - pos) * sizeof(Window));
+	stack[pos] = w;
+	n_stack++;
+}
+
+static int stack_index(Window w)
+{
+	for (int i = 0; i < n_stack; i++)
+		if (stack[i] == w)
+			return i;
+	return -1;
+}
+
+static Window new_window(int x, int y, int w, int h, int bw)
+{
+	if (!n_wins)
+		n_wins = 1;
+	if (n_wins == STUB_WINS) {
+		fprintf(stderr, "xstub: out of windows\n");
+		return None;
+	}
+	StubWin *sw = &wins[n_wins++];
+	*sw = (StubWin){.id = next_id++, .x = x, .y = y, .w = w, .h = h, .bw = bw};
+	stack[n_stack++] = sw->id;
+	return sw->id;
+}
+
+static void destroy_window(Window w)
+{
+	for (int i = 1; i < n_wins; i++) {
+		if (wins[i].id == w) {
+			for (int j = 0; j < wins[i].n_props; j++)
+				free(wins[i].props[j].data);
+			wins[i] = wins[--n_wins];
+			unstack(w);
+			return;
+		}
+	}
+}
+
+void stub_heads(int n, int w, int h)
+{
+	n_heads = n < 1 ? 1 : n > STUB_HEADS ? STUB_HEADS : n;
+	for (int i = 0; i < n_heads; i++)
+		heads[i] = (XineramaScreenInfo){.screen_number = i, .x_org = i * w, .y_org = 0,
+		                                .width = w, .height = h};
+}
+
+Window stub_window(int x, int y, int w, int h)
+{
+	return new_window(x, y, w, h, 0);
+}
+
+void stub_set_class(Window w, const char *name, const char *class)
+{
+	char buf[256];
+	int n = snprintf(buf, sizeof(buf), "%s%c%s", name, '\0', class);
+	if (n > 0 && (size_t)n < sizeof(buf))
+		stub_set_property(w, XA_WM_CLASS, XA_STRING, 8, buf, n + 1);
+}
+
+void stub_set_property(Window w, Atom name, Atom type, int format, const void *data, int n)
+{
+	StubWin *sw = win(w);
+	if (sw)
+		set_prop(sw, name, type, format, PropModeReplace, data, n);
+}
+
+void stub_delete_property(Window w, Atom name)
+{
+	StubWin *sw = win(w);
+	if (sw)
+		del_prop(sw, name);
+}
+
+void stub_map(Window w)
+{
+	StubWin *sw = win(w);
+	if (sw)
+		sw->mapped = True;
+}
+
+void stub_delay(const char *call, int ms)
+{
+	delay_call = call;
+	delay_ms = ms;
+}
+
+void stub_destroy(Window w)
+{
+	destroy_window(w);
+}
+
+void stub_pointer(int x, int y)
+{
+	ptr_x = x;
+	ptr_y = y;
+}
+
+Bool stub_mapped(Window w)
+{
+	StubWin *sw = win(w);
+	return sw && sw->mapped;
+}
+
+Window stub_focus(void)
+{
+	return focus;
+}
+
+Bool stub_has_property(Window w, Atom name)
+{
+	return prop(win(w), name) != NULL;
+}
+
+void stub_reset(void)
+{
+	stub_requests = 0;
+	stub_round_trips = 0;
+	n_calls = 0;
+}
+
+void stub_report(FILE *f)
+{
+	for (int i = 0; i < n_calls; i++)
+		fprintf(f, "\t%-24s %lu%s\n", calls[i].name, calls[i].n, calls[i].blocking ? " (blocking)" : "");
+}
+
+/* Xlib */
+
+Display *XOpenDisplay(const char *name)
+{
+	(void)name;
+	if (disp)
+		return (Display *)disp;
+
+	disp = calloc(1, sizeof(*disp));
+	Screen *scr = calloc(1, sizeof(Screen));
+	if (!disp || !scr)
+		return NULL;
+
+	int w = 0, h = 0;
+	for (int i = 0; i < n_heads; i++) {
+		if (heads[i].x_org + heads[i].width > w)
+			w = heads[i].x_org + heads[i].width;
+		if (heads[i].y_org + heads[i].height > h)
+			h = heads[i].y_org + heads[i].height;
+	}
+	if (!w || !h) {
+		stub_heads(1, 1280, 1024);
+		w = 1280;
+		h = 1024;
+	}
+
+	scr->display = (Display *)disp;
+	scr->root = STUB_ROOT;
+	scr->width = w;
+	scr->height = h;
+	scr->root_depth = 24;
+	scr->cmap = 1;
+	scr->white_pixel = 0xffffff;
+	scr->black_pixel = 0;
+	disp->screens = scr;
+	disp->nscreens = 1;
+	disp->default_screen = 0;
+	disp->fd = open("/dev/null", O_RDONLY);
+
+	/* windows made before the wm started stay, the root takes the display size */
+	wins[0].w = w;
+	wins[0].h = h;
+	if (!n_wins)
+		n_wins = 1;
+	req("XOpenDisplay", True);
+	return (Display *)disp;
+}
+
+int XCloseDisplay(Display *d)
+{
+	(void)d;
+	return 0;
+}
+
+int XFree(void *data)
+{
+	free(data);
+	return 1;
+}
+
+unsigned long XNextRequest(Display *d)
+{
+	(void)d;
+	return serial + 1;
+}
+
+int XFlush(Display *d)
+{
+	(void)d;
+	return 1;
+}
+
+int XSync(Display *d, Bool discard)
+{
+	(void)d;
+	if (discard)
+		q_len = 0;
+	req("XSync", True);
+	return 1;
+}
+
+int XPending(Display *d)
+{
+	(void)d;
+	return q_len;
+}
+
+int XNextEvent(Display *d, XEvent *ev)
+{
+	(void)d;
+	if (!q_len) {
+		fprintf(stderr, "xstub: XNextEvent with nothing queued\n");
+		exit(EXIT_FAILURE);
+	}
+	*ev = queue[q_head];
+	q_head = (q_head + 1) % STUB_EVENTS;
+	q_len--;
+	return 0;
+}
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler)
+{
+	static XErrorHandler current = NULL;
+	XErrorHandler old = current;
+	current = handler;
+	return old;
+}
+
+Window XDefaultRootWindow(Display *d)
+{
+	(void)d;
+	return STUB_ROOT;
+}
+
+int XDisplayWidth(Display *d, int screen)
+{
+	(void)screen;
+	return ((_XPrivDisplay)d)->screens[0].width;
+}
+
+int XDisplayHeight(Display *d, int screen)
+{
+	(void)screen;
+	return ((_XPrivDisplay)d)->screens[0].height;
+}
+
+Atom XInternAtom(Display *d, const char *name, Bool only_if_exists)
+{
+	(void)d;
+	req("XInternAtom", True);
+	return intern(name, only_if_exists);
+}
+
+int XChangeProperty(Display *d, Window w, Atom name, Atom type, int format, int mode,
+                    const unsigned char *data, int n)
+{
+	(void)d;
+	req("XChangeProperty", False);
+	StubWin *sw = win(w);
+	if (sw)
+		set_prop(sw, name, type, format, mode, data, n);
+	return 1;
+}
+
+int XDeleteProperty(Display *d, Window w, Atom name)
+{
+	(void)d;
+	req("XDeleteProperty", False);
+	StubWin *sw = win(w);
+	if (sw)
+		del_prop(sw, name);
+	return 1;
+}
+
+int XGetWindowProperty(Display *d, Window w, Atom name, long offset, long length, Bool delete,
+                       Atom req_type, Atom *type_ret, int *format_ret, unsigned long *n_ret,
+                       unsigned long *after_ret, unsigned char **data_ret)
+{
+	(void)d;
+	req("XGetWindowProperty", True);
+	StubWin *sw = win(w);
+	StubProp *p = prop(sw, name);
+
+	*type_ret = None;
+	*format_ret = 0;
+	*n_ret = 0;
+	*after_ret = 0;
+	*data_ret = NULL;
+	if (!sw)
+		return BadWindow;
+	if (!p)
+		return Success;
+
+	*type_ret = p->type;
+	*format_ret = p->format;
+	/* offsets and lengths are in 32 bit units on the wire */
+	unsigned long wire = p->format / 8;
+	unsigned long total = p->n * wire;
+	unsigned long start = 4 * (unsigned long)offset;
+	if (req_type != AnyPropertyType && req_type != p->type) {
+		*after_ret = total;
+		return Success;
+	}
+	if (start > total)
+		return BadValue;
+
+	unsigned long len = total - start;
+	if (len > 4 * (unsigned long)length)
+		len = 4 * (unsigned long)length;
+	unsigned long items = len / wire;
+	size_t u = unit(p->format);
+
+	*data_ret = calloc(items + 1, u);
+	memcpy(*data_ret, p->data + (start / wire) * u, items * u);
+	*n_ret = items;
+	*after_ret = total - start - len;
+	if (delete && !*after_ret)
+		del_prop(sw, name);
+	return Success;
+}
+
+Status XGetWindowAttributes(Display *d, Window w, XWindowAttributes *wa)
+{
+	(void)d;
+	req("XGetWindowAttributes", True);
+	StubWin *sw = win(w);
+	if (!sw)
+		return 0;
+
+	memset(wa, 0, sizeof(*wa));
+	wa->x = sw->x;
+	wa->y = sw->y;
+	wa->width = sw->w;
+	wa->height = sw->h;
+	wa->border_width = sw->bw;
+	wa->depth = 24;
+	wa->root = STUB_ROOT;
+	wa->class = InputOutput;
+	wa->map_state = sw->mapped ? IsViewable : IsUnmapped;
+	wa->override_redirect = sw->override_redirect;
+	wa->your_event_mask = sw->mask;
+	wa->screen = ((_XPrivDisplay)d)->screens;
+	return 1;
+}
+
+Status XGetClassHint(Display *d, Window w, XClassHint *ch)
+{
+	(void)d;
+	req("XGetClassHint", True);
+	StubProp *p = prop(win(w), XA_WM_CLASS);
+	if (!p || p->format != 8 || !p->n)
+		return 0;
+
+	size_t len = strnlen((char *)p->data, p->n);
+	ch->res_name = strndup((char *)p->data, len);
+	ch->res_class = strdup(len < p->n ? (char *)p->data + len + 1 : "");
+	return 1;
+}
+
+Status XGetTransientForHint(Display *d, Window w, Window *ret)
+{
+	(void)d;
+	req("XGetTransientForHint", True);
+	StubProp *p = prop(win(w), XA_WM_TRANSIENT_FOR);
+	if (!p || p->format != 32 || !p->n)
+		return 0;
+	*ret = ((Window *)p->data)[0];
+	return 1;
+}
+
+Status XGetWMNormalHints(Display *d, Window w, XSizeHints *hints, long *supplied)
+{
+	(void)d;
+	req("XGetWMNormalHints", True);
+	StubProp *p = prop(win(w), XA_WM_NORMAL_HINTS);
+
+	/* the 18 longs of the ICCCM WM_SIZE_HINTS layout */
+	if (!p || p->format != 32 || p->n < 15)
+		return 0;
+	long *v = (long *)p->data;
+	memset(hints, 0, sizeof(*hints));
+	hints->flags = v[0];
+	hints->min_width = v[5];
+	hints->min_height = v[6];
+	hints->max_width = v[7];
+	hints->max_height = v[8];
+	hints->width_inc = v[9];
+	hints->height_inc = v[10];
+	*supplied = v[0];
+	return 1;
+}
+
+Status XGetWMProtocols(Display *d, Window w, Atom **protos, int *n)
+{
+	(void)d;
+	/* Xlib caches the WM_PROTOCOLS atom, the property read is left */
+	req("XGetWMProtocols", True);
+	StubProp *p = prop(win(w), intern("WM_PROTOCOLS", True));
+	if (!p || p->format != 32)
+		return 0;
+	*protos = malloc((p->n + 1) * sizeof(Atom));
+	memcpy(*protos, p->data, p->n * sizeof(Atom));
+	*n = (int)p->n;
+	return 1;
+}
+
+Status XSetWMProtocols(Display *d, Window w, Atom *protos, int n)
+{
+	(void)d;
+	req("XSetWMProtocols", False);
+	StubWin *sw = win(w);
+	if (sw)
+		set_prop(sw, intern("WM_PROTOCOLS", False), XA_ATOM, 32, PropModeReplace,
+		         (unsigned char *)protos, n);
+	return 1;
+}
+
+Status XQueryTree(Display *d, Window w, Window *root_ret, Window *parent_ret, Window **children, unsigned int *n)
+{
+	(void)d;
+	req("XQueryTree", True);
+	if (!win(w))
+		return 0;
+
+	*root_ret = STUB_ROOT;
+	*parent_ret = w == STUB_ROOT ? None : STUB_ROOT;
+	*children = NULL;
+	*n = 0;
+	if (w == STUB_ROOT && n_stack) {
+		*children = malloc(n_stack * sizeof(Window));
+		memcpy(*children, stack, n_stack * sizeof(Window));
+		*n = n_stack;
+	}
+	return 1;
+}
+
+Bool XQueryPointer(Display *d, Window w, Window *root_ret, Window *child, int *rx, int *ry,
+                   int *wx, int *wy, unsigned int *mask)
+{
+	(void)d;
+	req("XQueryPointer", True);
+	StubWin *sw = win(w);
+
+	*root_ret = STUB_ROOT;
+	*child = None;
+	*rx = ptr_x;
+	*ry = ptr_y;
+	*wx = ptr_x - (sw ? sw->x : 0);
+	*wy = ptr_y - (sw ? sw->y : 0);
+	*mask = 0;
+
+	/* topmost mapped child of the root under the pointer */
+	if (w == STUB_ROOT) {
+		for (int i = n_stack - 1; i >= 0; i--) {
+			StubWin *c = win(stack[i]);
+			if (c && c->mapped && ptr_x >= c->x && ptr_x < c->x + c->w + 2 * c->bw &&
+			    ptr_y >= c->y && ptr_y < c->y + c->h + 2 * c->bw) {
+				*child = c->id;
+				break;
+			}
+		}
+	}
+	return True;
+}
+
+Window XCreateSimpleWindow(Display *d, Window parent, int x, int y, unsigned int w, unsigned int h,
+                           unsigned int bw, unsigned long border, unsigned long bg)
+{
+	(void)d;
+	(void)parent;
+	(void)border;
+	(void)bg;
+	req("XCreateSimpleWindow", False);
+	return new_window(x, y, (int)w, (int)h, (int)bw);
+}
+
+int XDestroyWindow(Display *d, Window w)
+{
+	(void)d;
+	req("XDestroyWindow", False);
+	destroy_window(w);
+	return 1;
+}
+
+int XMapWindow(Display *d, Window w)
+{
+	(void)d;
+	req("XMapWindow", False);
+	StubWin *sw = win(w);
+	if (sw)
+		sw->mapped = True;
+	return 1;
+}
+
+int XUnmapWindow(Display *d, Window w)
+{
+	(void)d;
+	req("XUnmapWindow", False);
+	StubWin *sw = win(w);
+	if (sw && sw->id != STUB_ROOT)
+		sw->mapped = False;
+	return 1;
+}
+
+int XConfigureWindow(Display *d, Window w, unsigned int mask, XWindowChanges *wc)
+{
+	(void)d;
+	req("XConfigureWindow", False);
+	StubWin *sw = win(w);
+	if (!sw)
+		return 1;
+
+	if (mask & CWX)
+		sw->x = wc->x;
+	if (mask & CWY)
+		sw->y = wc->y;
+	if (mask & CWWidth)
+		sw->w = wc->width;
+	if (mask & CWHeight)
+		sw->h = wc->height;
+	if (mask & CWBorderWidth)
+		sw->bw = wc->border_width;
+	if (mask & CWStackMode) {
+		int sib = (mask & CWSibling) ? stack_index(wc->sibling) : -1;
+		if (wc->stack_mode == Above)
+			restack_at(w, sib >= 0 ? sib + 1 : n_stack);
+		else if (wc->stack_mode == Below)
+			restack_at(w, sib >= 0 ? sib : 0);
+	}
+	return 1;
+}
+
+int XMoveWindow(Display *d, Window w, int x, int y)
+{
+	(void)d;
+	req("XMoveWindow", False);
+	StubWin *sw = win(w);
+	if (sw) {
+		sw->x = x;
+		sw->y = y;
+	}
+	return 1;
+}
+
+int XResizeWindow(Display *d, Window w, unsigned int width, unsigned int height)
+{
+	(void)d;
+	req("XResizeWindow", False);
+	StubWin *sw = win(w);
+	if (sw) {
+		sw->w = (int)width;
+		sw->h = (int)height;
+	}
+	return 1;
+}
+
+int XMoveResizeWindow(Display *d, Window w, int x, int y, unsigned int width, unsigned int height)
+{
+	(void)d;
+	req("XMoveResizeWindow", False);
+	StubWin *sw = win(w);
+	if (sw) {
+		sw->x = x;
+		sw->y = y;
+		sw->w = (int)width;
+		sw->h = (int)height;
+	}
+	return 1;
+}
+
+int XSetWindowBorderWidth(Display *d, Window w, unsigned int width)
+{
+	(void)d;
+	req("XSetWindowBorderWidth", False);
+	StubWin *sw = win(w);
+	if (sw)
+		sw->bw = (int)width;
+	return 1;
+}
+
+int XSetWindowBorder(Display *d, Window w, unsigned long pixel)
+{
+	(void)d;
+	(void)w;
+	(void)pixel;
+	req("XSetWindowBorder", False);
+	return 1;
+}
+
+int XRaiseWindow(Display *d, Window w)
+{
+	(void)d;
+	req("XRaiseWindow", False);
+	if (stack_index(w) >= 0)
+		restack_at(w, n_stack);
+	return 1;
+}
+
+int XRestackWindows(Display *d, Window *ws, int n)
+{
+	(void)d;
+	req("XRestackWindows", False);
+
+	/* each window goes directly below the one before it */
+	for (int i = 1; i < n; i++) {
+		if (stack_index(ws[i]) < 0)
+			continue;
+		unstack(ws[i]);
+		int above = stack_index(ws[i - 1]);
+		if (above >= 0)
+			restack_at(ws[i], above);
+	}
+	return 1;
+}
+
+int XSelectInput(Display *d, Window w, long mask)
+{
+	(void)d;
+	req("XSelectInput", False);
+	StubWin *sw = win(w);
+	if (sw)
+		sw->mask = mask;
+	return 1;
+}
+
+int XChangeWindowAttributes(Display *d, Window w, unsigned long valuemask, XSetWindowAttributes *wa)
+{
+	(void)d;
+	req("XChangeWindowAttributes", False);
+	StubWin *sw = win(w);
+	if (sw && (valuemask & CWEventMask))
+		sw->mask = wa->event_mask;
+	if (sw && (valuemask & CWOverrideRedirect))
+		sw->override_redirect = wa->override_redirect;
+	return 1;
+}
+
+int XDefineCursor(Display *d, Window w, Cursor c)
+{
+	(void)d;
+	(void)w;
+	(void)c;
+	req("XDefineCursor", False);
+	return 1;
+}
+
+int XFreeCursor(Display *d, Cursor c)
+{
+	(void)d;
+	(void)c;
+	req("XFreeCursor", False);
+	return 1;
+}
+
+int XSetInputFocus(Display *d, Window w, int revert, Time t)
+{
+	(void)d;
+	(void)revert;
+	(void)t;
+	req("XSetInputFocus", False);
+	focus = w;
+	return 1;
+}
+
+int XWarpPointer(Display *d, Window src, Window dst, int sx, int sy, unsigned int sw, unsigned int sh,
+                 int dx, int dy)
+{
+	(void)d;
+	(void)src;
+	(void)sx;
+	(void)sy;
+	(void)sw;
+	(void)sh;
+	req("XWarpPointer", False);
+	StubWin *w = win(dst);
+	ptr_x = dx + (w ? w->x : 0);
+	ptr_y = dy + (w ? w->y : 0);
+	return 1;
+}
+
+Status XSendEvent(Display *d, Window w, Bool propagate, long mask, XEvent *ev)
+{
+	(void)d;
+	(void)w;
+	(void)propagate;
+	(void)mask;
+	(void)ev;
+	req("XSendEvent", False);
+	return 1;
+}
+
+int XKillClient(Display *d, XID resource)
+{
+	(void)d;
+	(void)resource;
+	req("XKillClient", False);
+	return 1;
+}
+
+int XGrabServer(Display *d)
+{
+	(void)d;
+	req("XGrabServer", False);
+	return 1;
+}
+
+int XUngrabServer(Display *d)
+{
+	(void)d;
+	req("XUngrabServer", False);
+	return 1;
+}
+
+int XGrabPointer(Display *d, Window w, Bool owner, unsigned int mask, int pmode, int kmode,
+                 Window confine, Cursor c, Time t)
+{
+	(void)d;
+	(void)w;
+	(void)owner;
+	(void)mask;
+	(void)pmode;
+	(void)kmode;
+	(void)confine;
+	(void)c;
+	(void)t;
+	req("XGrabPointer", True);
+	return GrabSuccess;
+}
+
+int XUngrabPointer(Display *d, Time t)
+{
+	(void)d;
+	(void)t;
+	req("XUngrabPointer", False);
+	return 1;
+}
+
+int XAllowEvents(Display *d, int mode, Time t)
+{
+	(void)d;
+	(void)mode;
+	(void)t;
+	req("XAllowEvents", False);
+	return 1;
+}
+
+int XGrabButton(Display *d, unsigned int button, unsigned int mods, Window w, Bool owner,
+                unsigned int mask, int pmode, int kmode, Window confine, Cursor c)
+{
+	(void)d;
+	(void)button;
+	(void)mods;
+	(void)w;
+	(void)owner;
+	(void)mask;
+	(void)pmode;
+	(void)kmode;
+	(void)confine;
+	(void)c;
+	req("XGrabButton", False);
+	return 1;
+}
+
+int XUngrabButton(Display *d, unsigned int button, unsigned int mods, Window w)
+{
+	(void)d;
+	(void)button;
+	(void)mods;
+	(void)w;
+	req("XUngrabButton", False);
+	return 1;
+}
+
+int XGrabKey(Display *d, int code, unsigned int mods, Window w, Bool owner, int pmode, int kmode)
+{
+	(void)d;
+	(void)code;
+	(void)mods;
+	(void)w;
+	(void)owner;
+	(void)pmode;
+	(void)kmode;
+	req("XGrabKey", False);
+	return 1;
+}
+
+int XUngrabKey(Display *d, int code, unsigned int mods, Window w)
+{
+	(void)d;
+	(void)code;
+	(void)mods;
+	(void)w;
+	req("XUngrabKey", False);
+	return 1;
+}
+
+XModifierKeymap *XGetModifierMapping(Display *d)
+{
+	(void)d;
+	req("XGetModifierMapping", True);
+	XModifierKeymap *map = malloc(sizeof(*map));
+	if (!map)
+		return NULL;
+	map->max_keypermod = 1;
+	map->modifiermap = calloc(8, sizeof(KeyCode));
+	return map;
+}
+
+int XFreeModifiermap(XModifierKeymap *map)
+{
+	if (map)
+		free(map->modifiermap);
+	free(map);
+	return 1;
+}
+
+int XRefreshKeyboardMapping(XMappingEvent *ev)
+{
+	(void)ev;
+	return 1;
+}
+
+KeySym XStringToKeysym(const char *s)
+{
+	static const struct {
+		const char *name;
+		KeySym sym;
+	} names[] = {
+		{"Return", XK_Return}, {"space", XK_space}, {"Tab", XK_Tab}, {"Escape", XK_Escape},
+		{"comma", XK_comma}, {"period", XK_period}, {"equal", XK_equal}, {"minus", XK_minus},
+		{"Left", XK_Left}, {"Right", XK_Right}, {"Up", XK_Up}, {"Down", XK_Down},
+	};
+
+	if (s[0] && !s[1])
+		return (KeySym)(unsigned char)s[0];
+	if (s[0] == 'F' && s[1] >= '1' && s[1] <= '9')
+		return XK_F1 + atoi(s + 1) - 1;
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		if (strcmp(s, names[i].name) == 0)
+			return names[i].sym;
+	return NoSymbol;
+}
+
+KeyCode XKeysymToKeycode(Display *d, KeySym ks)
+{
+	(void)d;
+	/* a fixed made-up mapping is enough to match bindings to key presses */
+	return ks == NoSymbol ? 0 : (KeyCode)((ks & 0xff) < 8 ? (ks & 0xff) + 8 : ks & 0xff);
+}
+
+Status XParseColor(Display *d, Colormap cmap, const char *spec, XColor *col)
+{
+	(void)d;
+	(void)cmap;
+	unsigned int r, g, b;
+	if (sscanf(spec, "#%2x%2x%2x", &r, &g, &b) != 3)
+		return 0;
+	col->red = r * 257;
+	col->green = g * 257;
+	col->blue = b * 257;
+	col->flags = DoRed | DoGreen | DoBlue;
+	return 1;
+}
+
+Status XAllocColor(Display *d, Colormap cmap, XColor *col)
+{
+	(void)d;
+	(void)cmap;
+	req("XAllocColor", True);
+	col->pixel = ((unsigned long)(col->red >> 8) << 16) | ((col->green >> 8) << 8) | (col->blue >> 8);
+	return 1;
+}
+
+/* Xinerama */
+
+Bool XineramaIsActive(Display *d)
+{
+	(void)d;
+	req("XineramaIsActive", True);
+	return n_heads > 1;
+}
+
+XineramaScreenInfo *XineramaQueryScreens(Display *d, int *n)
+{
+	(void)d;
+	req("XineramaQueryScreens", True);
+	XineramaScreenInfo *info = malloc(n_heads * sizeof(*info));
+	if (!info)
+		return NULL;
+	memcpy(info, heads, n_heads * sizeof(*info));
+	*n = n_heads;
+	return info;
+}
+
+/* Xcursor */
+
+Cursor XcursorLibraryLoadCursor(Display *d, const char *name)
+{
+	(void)d;
+	(void)name;
+	req("XcursorLibraryLoadCursor", False);
+	return next_cursor++;
+}
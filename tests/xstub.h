@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdio.h>
+#include <X11/Xlib.h>
+
+/* requests sxwm issued, and how many of them waited for a reply */
+extern unsigned long stub_requests;
+extern unsigned long stub_round_trips;
+
+/* server side setup, called before sxwm opens the display */
+void stub_heads(int n, int w, int h);
+
+/* what a client would do: create, label and change its windows */
+Window stub_window(int x, int y, int w, int h);
+void stub_set_class(Window w, const char *name, const char *class);
+void stub_set_property(Window w, Atom prop, Atom type, int format, const void *data, int n);
+void stub_delete_property(Window w, Atom prop);
+void stub_destroy(Window w);
+void stub_map(Window w);
+void stub_pointer(int x, int y);
+/* calls named call take ms longer until stub_delay(NULL, 0), NULL delays the next round trip only */
+void stub_delay(const char *call, int ms);
+
+/* server state as sxwm left it */
+Bool stub_mapped(Window w);
+Window stub_focus(void);
+Bool stub_has_property(Window w, Atom prop);
+
+/* request accounting */
+void stub_reset(void);
+void stub_report(FILE *f);